@@ -0,0 +1,723 @@
+#include "jsonbind.h"
+#include "jsonbinary.h"
+#include "jsonparser.h"
+#include "jsonwriter.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+using namespace jsonparser;
+
+///===-----------------------------------------------------------------------===
+///
+///               Allocation Counting
+///
+///===-----------------------------------------------------------------------===
+
+// Every allocation of the process goes through these, the arena's blocks and
+// the lexer's buffers included.
+static std::atomic<size_t> allocations{0};
+static std::atomic<size_t> allocated_bytes{0};
+
+void *operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (void *p = malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+// Peak resident set size of the process so far, in bytes; 0 where unknown.
+static size_t peak_rss() {
+#if defined(_WIN32)
+  return 0;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage))
+    return 0;
+#if defined(__APPLE__)
+  return usage.ru_maxrss;
+#else
+  return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+///===-----------------------------------------------------------------------===
+///
+///               Corpora
+///
+///===-----------------------------------------------------------------------===
+
+// xorshift64*, so every run and platform generates the same bytes.
+class corpus_random {
+  uint64_t state;
+
+public:
+  explicit corpus_random(uint64_t seed) : state(seed) {}
+
+  uint64_t next() {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545f4914f6cdd1dull;
+  }
+
+  // In [0, n).
+  size_t below(size_t n) { return next() % n; }
+  double unit() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+};
+
+static json_number real(double value) {
+  json_number num;
+  num.type = json_number_type::real;
+  num.d = value;
+  return num;
+}
+
+static void append_number(std::string &out, double value) {
+  char text[json_number_chars];
+  out.append(text, json_format_number(real(value), text) - text);
+}
+
+static void append_integer(std::string &out, long long value) {
+  out += std::to_string(value);
+}
+
+// Words with an escape or a multibyte UTF-8 sequence now and then.
+static void append_text(std::string &out, corpus_random &rng, size_t words) {
+  static const char *vocabulary[] = {
+      "hello",      "world",     "parser",     "json",   "tweet",
+      "caf\xc3\xa9", "\xe4\xb8\xad\xe6\x96\x87", "\xf0\x9f\x98\x80",
+      "\\\"quoted\\\"", "line\\nbreak", "tab\\there", "\\u00e9t\\u00e9",
+      "back\\\\slash", "number", "stream",   "value"};
+  const size_t count = sizeof(vocabulary) / sizeof(*vocabulary);
+  for (size_t i = 0; i < words; i++) {
+    if (i)
+      out += ' ';
+    out += vocabulary[rng.below(count)];
+  }
+}
+
+static void append_record(std::string &out, corpus_random &rng, size_t id) {
+  out += "{\"id\":";
+  append_integer(out, id);
+  out += ",\"user\":{\"name\":\"user";
+  append_integer(out, rng.below(1000000));
+  out += "\",\"screen_name\":\"sn_";
+  append_integer(out, rng.next() & 0xffffffff);
+  out += "\",\"followers\":";
+  append_integer(out, rng.below(5000000));
+  out += ",\"verified\":";
+  out += rng.below(10) ? "false" : "true";
+  out += "},\"text\":\"";
+  append_text(out, rng, 6 + rng.below(20));
+  out += "\",\"retweets\":";
+  append_integer(out, rng.below(1000));
+  out += ",\"coords\":";
+  if (rng.below(4)) {
+    out += '[';
+    append_number(out, rng.unit() * 360 - 180);
+    out += ',';
+    append_number(out, rng.unit() * 180 - 90);
+    out += ']';
+  } else {
+    out += "null";
+  }
+  out += ",\"tags\":[";
+  for (size_t i = 0, n = rng.below(4); i < n; i++) {
+    if (i)
+      out += ',';
+    out += "\"tag";
+    append_integer(out, rng.below(100));
+    out += '"';
+  }
+  out += "]}";
+}
+
+// The records as structs, for json_parser::parse_into().
+struct bench_user {
+  std::string name;
+  std::string screen_name;
+  long long followers = 0;
+  bool verified = false;
+};
+JSON_FIELDS(bench_user, name, screen_name, followers, verified)
+
+struct bench_record {
+  unsigned long long id = 0;
+  bench_user user;
+  std::string text;
+  int retweets = 0;
+  std::optional<std::vector<double>> coords;
+  std::vector<std::string> tags;
+};
+JSON_FIELDS(bench_record, id, user, text, retweets, coords, tags)
+
+// Twitter-like records in one array.
+static std::string make_twitter(size_t size) {
+  corpus_random rng(1);
+  std::string out = "[";
+  for (size_t id = 0; out.size() < size; id++) {
+    if (id)
+      out += ",\n";
+    append_record(out, rng, id);
+  }
+  out += "]";
+  return out;
+}
+
+// The same records, one document per line.
+static std::string make_lines(size_t size) {
+  corpus_random rng(2);
+  std::string out;
+  for (size_t id = 0; out.size() < size; id++) {
+    append_record(out, rng, id);
+    out += '\n';
+  }
+  return out;
+}
+
+// Rows of integers, decimals and exponents.
+static std::string make_numeric(size_t size) {
+  corpus_random rng(3);
+  std::string out = "[";
+  for (size_t row = 0; out.size() < size; row++) {
+    out += row ? ",[" : "[";
+    for (size_t i = 0; i < 8; i++) {
+      if (i)
+        out += ',';
+      switch (rng.below(3)) {
+      case 0:
+        append_integer(out, (long long)rng.below(2000000) - 1000000);
+        break;
+      case 1:
+        append_number(out, rng.unit() * 1000 - 500);
+        break;
+      default:
+        append_number(out, (rng.unit() - 0.5) * 1e-300 * (double)rng.next());
+        break;
+      }
+    }
+    out += ']';
+  }
+  out += "]";
+  return out;
+}
+
+// Strings of a few kilobytes, escapes and UTF-8 throughout.
+static std::string make_strings(size_t size) {
+  corpus_random rng(4);
+  std::string out = "[";
+  for (size_t i = 0; out.size() < size; i++) {
+    out += i ? ",\"" : "\"";
+    append_text(out, rng, 200 + rng.below(400));
+    out += '"';
+  }
+  out += "]";
+  return out;
+}
+
+// Objects and arrays nested a thousand deep, repeated.
+static std::string make_deep(size_t size) {
+  const size_t depth = 1000;
+  std::string out = "[";
+  for (size_t i = 0; out.size() < size; i++) {
+    if (i)
+      out += ',';
+    for (size_t d = 0; d < depth; d++)
+      out += d & 1 ? "{\"a\":" : "[";
+    append_integer(out, i);
+    for (size_t d = depth; d-- > 0;)
+      out += d & 1 ? "}" : "]";
+  }
+  out += "]";
+  return out;
+}
+
+// One object with a distinct key per member.
+static std::string make_wide(size_t size) {
+  corpus_random rng(5);
+  std::string out = "{";
+  for (size_t i = 0; out.size() < size; i++) {
+    out += i ? ",\"key_" : "\"key_";
+    append_integer(out, i);
+    out += "\":";
+    append_integer(out, rng.below(1000));
+  }
+  out += "}";
+  return out;
+}
+
+struct typed_reading {
+  double seconds = 0;
+  size_t items = 0;
+  size_t allocations = 0;
+  bool ok = true;
+};
+
+template <typename T>
+static typed_reading read_typed(const std::string &data, bool lines);
+
+struct corpus {
+  const char *name;
+  std::string (*make)(size_t size);
+  bool lines; // parsed as a sequence of documents
+  // Reads the corpus into plain types, for corpora with a schema.
+  typed_reading (*typed)(const std::string &data, bool lines);
+};
+
+static const corpus corpora[] = {
+    {"twitter", make_twitter, false, read_typed<bench_record>},
+    {"lines", make_lines, true, read_typed<bench_record>},
+    {"numeric", make_numeric, false, read_typed<std::vector<double>>},
+    {"strings", make_strings, false, read_typed<std::string>},
+    {"deep", make_deep, false, nullptr},
+    {"wide", make_wide, false, nullptr},
+};
+
+///===-----------------------------------------------------------------------===
+///
+///               Measurement
+///
+///===-----------------------------------------------------------------------===
+
+// One corpus through json_binary_encoder and back through
+// json_binary_decoder.
+struct transcoding {
+  json_binary_format format;
+  size_t bytes = 0; // encoded
+  double encode_seconds = 0;
+  double decode_seconds = 0;
+  bool ok = true;
+};
+
+static const char *format_name(json_binary_format format) {
+  return format == json_binary_format::cbor ? "cbor" : "msgpack";
+}
+
+struct measurement {
+  const corpus *source;
+  size_t bytes = 0;
+  size_t documents = 0; // per iteration
+  double parse_seconds = 0;
+  double print_seconds = 0;
+  size_t output_bytes = 0;
+  size_t parse_allocations = 0; // per iteration
+  size_t parse_allocated = 0;
+  size_t peak_rss = 0;
+  bool ok = true;
+  std::vector<transcoding> binary;
+  typed_reading typed; // if source->typed
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// The elements of the top-level array, or the documents of a sequence, read
+// into a std::vector<T>: no nodes, every allocation is the structs' own.
+template <typename T>
+static typed_reading read_typed(const std::string &data, bool lines) {
+  typed_reading r;
+  std::vector<T> items;
+  size_t allocs = allocations.load();
+  auto start = std::chrono::steady_clock::now();
+
+  json_parser ps(data, json_buffer_mode::borrow, 1024 * 256);
+  if (lines) {
+    ps.sequence() = true;
+    while (r.ok && ps.more())
+      r.ok = ps.parse_into(items.emplace_back());
+  } else {
+    r.ok = ps.parse_into(items);
+  }
+
+  r.seconds = seconds_since(start);
+  r.allocations = allocations.load() - allocs;
+  r.items = items.size();
+  return r;
+}
+
+// Encode data straight from the parse events, then decode it to trees; the
+// fastest iteration counts. The encoder takes one document per parse, so a
+// sequence is encoded line by line, each line a value of its own.
+static transcoding transcode(const corpus &source, const std::string &data,
+                             size_t iterations, json_binary_format format) {
+  transcoding t;
+  t.format = format;
+  t.encode_seconds = t.decode_seconds = 1e300;
+
+  std::vector<std::string_view> documents;
+  if (source.lines) {
+    for (size_t at = 0, end; at < data.size(); at = end + 1) {
+      end = std::min(data.find('\n', at), data.size());
+      if (end > at)
+        documents.emplace_back(data.data() + at, end - at);
+    }
+  } else {
+    documents.emplace_back(data);
+  }
+
+  std::string out;
+  std::vector<size_t> ends;
+  for (size_t i = 0; i < iterations && t.ok; i++) {
+    out.clear();
+    ends.clear();
+    auto start = std::chrono::steady_clock::now();
+    {
+      json_parser ps(1024 * 256);
+      json_binary_encoder encoder(out, format);
+      for (auto document : documents) {
+        ps.reset(document, json_buffer_mode::borrow);
+        if (!(t.ok = ps.parse_events(encoder)))
+          break;
+        encoder.finish();
+        ends.push_back(out.size());
+      }
+    }
+    t.encode_seconds = std::min(t.encode_seconds, seconds_since(start));
+    t.bytes = out.size();
+    if (!t.ok)
+      break;
+
+    start = std::chrono::steady_clock::now();
+    {
+      json_binary_decoder decoder(1024 * 256);
+      for (size_t j = 0, at = 0; j < ends.size() && t.ok; at = ends[j++])
+        t.ok = decoder.decode(out.data() + at, ends[j] - at, format) != nullptr;
+    }
+    t.decode_seconds = std::min(t.decode_seconds, seconds_since(start));
+  }
+  return t;
+}
+
+// Fixed costs of a short message: constructing a lexer, a parser, and a
+// parser that also parses, each on a message of a few dozen bytes.
+struct setup_reading {
+  size_t bytes = 0;
+  double lexer_seconds = 1e300; // per message
+  double parser_seconds = 1e300;
+  double parse_seconds = 1e300;
+  size_t allocations = 0; // per parsed message
+  size_t allocated = 0;
+  bool ok = true;
+};
+
+static setup_reading measure_setup(size_t iterations) {
+  static const char message[] =
+      "{\"id\":1042,\"type\":\"tick\",\"price\":101.25,\"open\":true}";
+  const size_t size = sizeof(message) - 1, repeats = 20000;
+
+  setup_reading r;
+  r.bytes = size;
+  for (size_t i = 0; i < iterations && r.ok; i++) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t j = 0; j < repeats; j++) {
+      json_lexer lex(message, size, json_buffer_mode::borrow);
+      r.ok &= lex.next();
+    }
+    r.lexer_seconds = std::min(r.lexer_seconds, seconds_since(start) / repeats);
+
+    start = std::chrono::steady_clock::now();
+    for (size_t j = 0; j < repeats; j++) {
+      json_parser ps(message, size, json_buffer_mode::borrow);
+      r.ok &= ps.filesize() == (long long)size;
+    }
+    r.parser_seconds =
+        std::min(r.parser_seconds, seconds_since(start) / repeats);
+
+    size_t allocs = allocations.load(), bytes = allocated_bytes.load();
+    start = std::chrono::steady_clock::now();
+    for (size_t j = 0; j < repeats; j++) {
+      json_parser ps(message, size, json_buffer_mode::borrow);
+      r.ok &= ps.parse();
+    }
+    r.parse_seconds = std::min(r.parse_seconds, seconds_since(start) / repeats);
+    r.allocations = (allocations.load() - allocs) / repeats;
+    r.allocated = (allocated_bytes.load() - bytes) / repeats;
+  }
+  return r;
+}
+
+// Parse and print data iterations times; the fastest iteration counts.
+static measurement run(const corpus &source, const std::string &data,
+                       size_t iterations) {
+  measurement m;
+  m.source = &source;
+  m.bytes = data.size();
+  m.parse_seconds = m.print_seconds = 1e300;
+
+  std::string out;
+  for (size_t i = 0; i < iterations && m.ok; i++) {
+    size_t allocs = allocations.load(), bytes = allocated_bytes.load();
+    auto start = std::chrono::steady_clock::now();
+
+    json_parser ps(data, json_buffer_mode::borrow, 1024 * 256);
+    std::vector<jvalue> docs;
+    ps.sequence() = source.lines;
+    while (ps.more() && (m.ok = ps.parse()))
+      docs.push_back(ps.entry());
+
+    m.parse_seconds = std::min(m.parse_seconds, seconds_since(start));
+    m.parse_allocations = allocations.load() - allocs;
+    m.parse_allocated = allocated_bytes.load() - bytes;
+    m.documents = docs.size();
+    if (!m.ok)
+      break;
+
+    out.clear();
+    start = std::chrono::steady_clock::now();
+    {
+      json_writer writer(out);
+      for (auto &doc : docs) {
+        writer.write(*doc);
+        writer.raw("\n");
+      }
+    }
+    m.print_seconds = std::min(m.print_seconds, seconds_since(start));
+    m.output_bytes = out.size();
+  }
+  if (m.ok)
+    for (auto format : {json_binary_format::cbor, json_binary_format::msgpack})
+      m.binary.push_back(transcode(source, data, iterations, format));
+  for (size_t i = 0; m.ok && source.typed && i < iterations; i++) {
+    typed_reading r = source.typed(data, source.lines);
+    if (!i || !r.ok || r.seconds < m.typed.seconds)
+      m.typed = r;
+    if (!r.ok)
+      break;
+  }
+  m.peak_rss = peak_rss();
+  return m;
+}
+
+static void report_setup(const setup_reading &r) {
+  if (!r.ok) {
+    printf("setup    parse error\n");
+    return;
+  }
+  printf("%-8s %6s %10s %10s %10s %12s %10s\n", "setup", "bytes", "lexer us",
+         "parser us", "parse us", "allocations", "alloc KB");
+  printf("%-8s %6zu %10.2f %10.2f %10.2f %12zu %10.1f\n", "message", r.bytes,
+         r.lexer_seconds * 1e6, r.parser_seconds * 1e6, r.parse_seconds * 1e6,
+         r.allocations, r.allocated / 1e3);
+}
+
+static void report_table(const std::vector<measurement> &results) {
+  printf("%-8s %9s %6s %10s %12s %10s %12s %10s %10s\n", "corpus", "MB",
+         "docs", "parse MB/s", "docs/s", "print MB/s", "allocations",
+         "alloc MB", "peak MB");
+  for (auto &m : results) {
+    if (!m.ok) {
+      printf("%-8s parse error\n", m.source->name);
+      continue;
+    }
+    double mb = m.bytes / 1e6;
+    printf("%-8s %9.1f %6zu %10.1f %12.0f %10.1f %12zu %10.1f %10.1f\n",
+           m.source->name, mb, m.documents, mb / m.parse_seconds,
+           m.documents / m.parse_seconds,
+           m.output_bytes / 1e6 / m.print_seconds, m.parse_allocations,
+           m.parse_allocated / 1e6, m.peak_rss / 1e6);
+  }
+
+  // Encoding is measured against the JSON bytes in, decoding against the
+  // encoded bytes in.
+  printf("\n%-8s %-8s %9s %7s %11s %11s\n", "corpus", "format", "MB",
+         "% json", "encode MB/s", "decode MB/s");
+  for (auto &m : results)
+    for (auto &t : m.binary) {
+      if (!t.ok) {
+        printf("%-8s %-8s error\n", m.source->name, format_name(t.format));
+        continue;
+      }
+      printf("%-8s %-8s %9.1f %7.1f %11.1f %11.1f\n", m.source->name,
+             format_name(t.format), t.bytes / 1e6, 100.0 * t.bytes / m.bytes,
+             m.bytes / 1e6 / t.encode_seconds,
+             t.bytes / 1e6 / t.decode_seconds);
+    }
+
+  // json_parser::parse_into() against the parse above.
+  printf("\n%-8s %10s %12s %12s %8s\n", "corpus", "typed MB/s", "items/s",
+         "allocations", "vs dom");
+  for (auto &m : results) {
+    if (!m.ok || !m.source->typed)
+      continue;
+    const typed_reading &t = m.typed;
+    if (!t.ok) {
+      printf("%-8s parse error\n", m.source->name);
+      continue;
+    }
+    printf("%-8s %10.1f %12.0f %12zu %7.2fx\n", m.source->name,
+           m.bytes / 1e6 / t.seconds, t.items / t.seconds, t.allocations,
+           m.parse_seconds / t.seconds);
+  }
+}
+
+static void report_json(const std::vector<measurement> &results,
+                        const setup_reading *setup, size_t iterations) {
+  std::string out;
+  json_writer writer(out);
+  char field[json_number_chars];
+  auto number = [&](const char *key, double value) {
+    writer.raw(",");
+    writer.string(key);
+    writer.raw(":");
+    char *end = json_format_number(real(value), field);
+    writer.raw(std::string_view(field, end - field));
+  };
+  auto count = [&](const char *key, size_t value) {
+    writer.raw(",");
+    writer.string(key);
+    writer.raw(":");
+    writer.raw(std::to_string(value));
+  };
+
+  writer.raw("{\"iterations\":");
+  writer.raw(std::to_string(iterations));
+  writer.raw(",\"corpora\":[");
+  for (size_t i = 0; i < results.size(); i++) {
+    const measurement &m = results[i];
+    writer.raw(i ? ",{\"name\":" : "{\"name\":");
+    writer.string(m.source->name);
+    writer.raw(m.ok ? ",\"ok\":true" : ",\"ok\":false");
+    count("bytes", m.bytes);
+    count("documents", m.documents);
+    if (m.ok) {
+      number("parse_seconds", m.parse_seconds);
+      number("parse_mb_per_s", m.bytes / 1e6 / m.parse_seconds);
+      number("documents_per_s", m.documents / m.parse_seconds);
+      number("print_seconds", m.print_seconds);
+      number("print_mb_per_s", m.output_bytes / 1e6 / m.print_seconds);
+      count("allocations", m.parse_allocations);
+      count("allocated_bytes", m.parse_allocated);
+      writer.raw(",\"binary\":[");
+      for (size_t j = 0; j < m.binary.size(); j++) {
+        const transcoding &t = m.binary[j];
+        writer.raw(j ? ",{\"format\":" : "{\"format\":");
+        writer.string(format_name(t.format));
+        writer.raw(t.ok ? ",\"ok\":true" : ",\"ok\":false");
+        if (t.ok) {
+          count("bytes", t.bytes);
+          number("encode_seconds", t.encode_seconds);
+          number("encode_mb_per_s", m.bytes / 1e6 / t.encode_seconds);
+          number("decode_seconds", t.decode_seconds);
+          number("decode_mb_per_s", t.bytes / 1e6 / t.decode_seconds);
+        }
+        writer.raw("}");
+      }
+      writer.raw("]");
+      if (m.source->typed) {
+        writer.raw(m.typed.ok ? ",\"typed\":{\"ok\":true"
+                              : ",\"typed\":{\"ok\":false");
+        if (m.typed.ok) {
+          number("seconds", m.typed.seconds);
+          number("mb_per_s", m.bytes / 1e6 / m.typed.seconds);
+          count("items", m.typed.items);
+          count("allocations", m.typed.allocations);
+        }
+        writer.raw("}");
+      }
+    }
+    count("peak_rss_bytes", m.peak_rss);
+    writer.raw("}");
+  }
+  writer.raw("]");
+  if (setup) {
+    writer.raw(setup->ok ? ",\"setup\":{\"ok\":true"
+                         : ",\"setup\":{\"ok\":false");
+    count("bytes", setup->bytes);
+    if (setup->ok) {
+      number("lexer_seconds", setup->lexer_seconds);
+      number("parser_seconds", setup->parser_seconds);
+      number("parse_seconds", setup->parse_seconds);
+      count("allocations", setup->allocations);
+      count("allocated_bytes", setup->allocated);
+    }
+    writer.raw("}");
+  }
+  writer.raw("}\n");
+  writer.flush();
+  fwrite(out.data(), 1, out.size(), stdout);
+}
+
+int main(int argc, char *argv[]) {
+  size_t size = 1024 * 1024 * 16;
+  size_t iterations = 5;
+  bool json = false;
+  std::vector<std::string> only;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--json"))
+      json = true;
+    else if (!strcmp(argv[i], "--size") && i + 1 < argc)
+      size = (size_t)(atof(argv[++i]) * 1024 * 1024);
+    else if (!strcmp(argv[i], "--iterations") && i + 1 < argc)
+      iterations = std::max(1, atoi(argv[++i]));
+    else if (argv[i][0] != '-')
+      only.push_back(argv[i]);
+    else {
+      std::cout << argv[0]
+                << " [--json] [--size <MB>] [--iterations <n>] [corpus]...\n"
+                   "corpora: twitter lines numeric strings deep wide\n"
+                   "setup: a short message's lexer and parser construction\n";
+      return 0;
+    }
+  }
+
+  // Peak RSS only grows, so each corpus is generated, measured and freed
+  // before the next; its figure is the peak up to then.
+  std::vector<measurement> results;
+  for (auto &source : corpora) {
+    if (!only.empty() &&
+        std::find(only.begin(), only.end(), source.name) == only.end())
+      continue;
+    std::string data = source.make(size);
+    results.push_back(run(source, data, iterations));
+  }
+
+  setup_reading setup;
+  bool with_setup = only.empty() ||
+                    std::find(only.begin(), only.end(), "setup") != only.end();
+  if (with_setup)
+    setup = measure_setup(iterations);
+
+  if (json) {
+    report_json(results, with_setup ? &setup : nullptr, iterations);
+  } else {
+    if (!results.empty())
+      report_table(results);
+    if (with_setup) {
+      if (!results.empty())
+        printf("\n");
+      report_setup(setup);
+    }
+  }
+
+  for (auto &m : results) {
+    if (!m.ok)
+      return 1;
+    for (auto &t : m.binary)
+      if (!t.ok)
+        return 1;
+    if (m.source->typed && !m.typed.ok)
+      return 1;
+  }
+  return with_setup && !setup.ok;
+}
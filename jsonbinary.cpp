@@ -0,0 +1,657 @@
+#include "jsonbinary.h"
+#include <algorithm>
+#include <cmath>
+#include <memory.h>
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Binary Encoder
+///
+///===-----------------------------------------------------------------------===
+
+// The low bytes of value, most significant first.
+static inline void put_big_endian(char *to, uint64_t value, size_t bytes) {
+  for (size_t i = bytes; i-- > 0; value >>= 8)
+    to[i] = (char)(value & 0xff);
+}
+
+jsonparser::json_binary_encoder::json_binary_encoder(std::string &out,
+                                                     json_binary_format format)
+    : out(out), format(format), begin(out.size()) {}
+
+void jsonparser::json_binary_encoder::start(bool object) {
+  open.push_back(containers.size());
+  containers.push_back({out.size(), 0, object});
+  out.append(placeholder, '\0');
+}
+
+// CBOR head: major type and argument, the argument as short as it goes.
+void jsonparser::json_binary_encoder::head(unsigned major, uint64_t n) {
+  char buf[9];
+  size_t size;
+  if (n < 24) {
+    buf[0] = (char)(major << 5 | n);
+    size = 1;
+  } else if (n <= 0xff) {
+    buf[0] = (char)(major << 5 | 24);
+    size = 2;
+  } else if (n <= 0xffff) {
+    buf[0] = (char)(major << 5 | 25);
+    size = 3;
+  } else if (n <= 0xffffffff) {
+    buf[0] = (char)(major << 5 | 26);
+    size = 5;
+  } else {
+    buf[0] = (char)(major << 5 | 27);
+    size = 9;
+  }
+  if (size > 1)
+    put_big_endian(buf + 1, n, size - 1);
+  out.append(buf, size);
+}
+
+// Header of c written to to, at most placeholder bytes. Returns its size.
+size_t jsonparser::json_binary_encoder::container_head(const container &c,
+                                                       char *to) const {
+  uint64_t n = c.count;
+  if (format == json_binary_format::cbor) {
+    unsigned major = c.object ? 5 : 4;
+    if (n < 24) {
+      to[0] = (char)(major << 5 | n);
+      return 1;
+    }
+    size_t bytes = n <= 0xff ? 1 : n <= 0xffff ? 2 : 4;
+    to[0] = (char)(major << 5 | (bytes == 1 ? 24 : bytes == 2 ? 25 : 26));
+    put_big_endian(to + 1, n, bytes);
+    return 1 + bytes;
+  }
+
+  if (n < 16) {
+    to[0] = (char)((c.object ? 0x80 : 0x90) | n);
+    return 1;
+  }
+  if (n <= 0xffff) {
+    to[0] = (char)(c.object ? 0xde : 0xdc);
+    put_big_endian(to + 1, n, 2);
+    return 3;
+  }
+  to[0] = (char)(c.object ? 0xdf : 0xdd);
+  put_big_endian(to + 1, n, 4);
+  return 5;
+}
+
+void jsonparser::json_binary_encoder::string(std::string_view str) {
+  size_t n = str.size();
+  if (format == json_binary_format::cbor) {
+    head(3, n);
+  } else {
+    char buf[5];
+    size_t size;
+    if (n < 32) {
+      buf[0] = (char)(0xa0 | n);
+      size = 1;
+    } else if (n <= 0xff) {
+      buf[0] = (char)0xd9;
+      size = 2;
+    } else if (n <= 0xffff) {
+      buf[0] = (char)0xda;
+      size = 3;
+    } else {
+      buf[0] = (char)0xdb;
+      size = 5;
+    }
+    if (size > 1)
+      put_big_endian(buf + 1, n, size - 1);
+    out.append(buf, size);
+  }
+  out.append(str.data(), n);
+}
+
+void jsonparser::json_binary_encoder::unsigned_integer(uint64_t value) {
+  if (format == json_binary_format::cbor) {
+    head(0, value);
+    return;
+  }
+
+  char buf[9];
+  size_t size;
+  if (value < 0x80) {
+    buf[0] = (char)value;
+    size = 1;
+  } else if (value <= 0xff) {
+    buf[0] = (char)0xcc;
+    size = 2;
+  } else if (value <= 0xffff) {
+    buf[0] = (char)0xcd;
+    size = 3;
+  } else if (value <= 0xffffffff) {
+    buf[0] = (char)0xce;
+    size = 5;
+  } else {
+    buf[0] = (char)0xcf;
+    size = 9;
+  }
+  if (size > 1)
+    put_big_endian(buf + 1, value, size - 1);
+  out.append(buf, size);
+}
+
+void jsonparser::json_binary_encoder::integer(int64_t value) {
+  if (value >= 0) {
+    unsigned_integer((uint64_t)value);
+    return;
+  }
+  if (format == json_binary_format::cbor) {
+    // -1 - n, n computed without overflowing at INT64_MIN.
+    head(1, (uint64_t)(-(value + 1)));
+    return;
+  }
+
+  char buf[9];
+  size_t size;
+  if (value >= -32) {
+    buf[0] = (char)value;
+    size = 1;
+  } else if (value >= INT8_MIN) {
+    buf[0] = (char)0xd0;
+    size = 2;
+  } else if (value >= INT16_MIN) {
+    buf[0] = (char)0xd1;
+    size = 3;
+  } else if (value >= INT32_MIN) {
+    buf[0] = (char)0xd2;
+    size = 5;
+  } else {
+    buf[0] = (char)0xd3;
+    size = 9;
+  }
+  if (size > 1)
+    put_big_endian(buf + 1, (uint64_t)value, size - 1);
+  out.append(buf, size);
+}
+
+// Single precision where it holds the value exactly, double otherwise.
+void jsonparser::json_binary_encoder::real(double value) {
+  bool cbor = format == json_binary_format::cbor;
+  char buf[9];
+  float single = (float)value;
+  if ((double)single == value) {
+    uint32_t bits;
+    memcpy(&bits, &single, sizeof(bits));
+    buf[0] = (char)(cbor ? 0xfa : 0xca);
+    put_big_endian(buf + 1, bits, 4);
+    out.append(buf, 5);
+  } else {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    buf[0] = (char)(cbor ? 0xfb : 0xcb);
+    put_big_endian(buf + 1, bits, 8);
+    out.append(buf, 9);
+  }
+}
+
+bool jsonparser::json_binary_encoder::on_number(const json_number &num,
+                                                std::string_view) {
+  count_value();
+  switch (num.type) {
+  case json_number_type::int64:
+    integer(num.i);
+    break;
+  case json_number_type::uint64:
+    unsigned_integer(num.u);
+    break;
+  default:
+    real(num.d);
+    break;
+  }
+  return true;
+}
+
+bool jsonparser::json_binary_encoder::on_bool(bool value) {
+  count_value();
+  if (format == json_binary_format::cbor)
+    out += (char)(value ? 0xf5 : 0xf4);
+  else
+    out += (char)(value ? 0xc3 : 0xc2);
+  return true;
+}
+
+bool jsonparser::json_binary_encoder::on_null() {
+  count_value();
+  out += (char)(format == json_binary_format::cbor ? 0xf6 : 0xc0);
+  return true;
+}
+
+// Placeholders are in document order, so the output is compacted front to
+// back: everything between two of them moves down by the bytes saved so far.
+void jsonparser::json_binary_encoder::finish() {
+  size_t read = begin, write = begin;
+  char *data = &out[0];
+  for (const container &c : containers) {
+    memmove(data + write, data + read, c.offset - read);
+    write += c.offset - read;
+    write += container_head(c, data + write);
+    read = c.offset + placeholder;
+  }
+  memmove(data + write, data + read, out.size() - read);
+  write += out.size() - read;
+  out.resize(write);
+
+  containers.clear();
+  open.clear();
+  begin = out.size();
+}
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Binary Decoder
+///
+///===-----------------------------------------------------------------------===
+
+jsonparser::json_binary_decoder::json_binary_decoder(size_t arena_block)
+#ifdef CONFIG_ALLOCATOR
+    : _arena(arena_block), resource(&_arena),
+#else
+    : resource(std::pmr::new_delete_resource()),
+#endif
+      key_table(std::make_shared<json_key_table>()) {
+}
+
+bool jsonparser::json_binary_decoder::fail(const unsigned char *at) {
+  _error_position = at - first;
+  frames.clear();
+  return false;
+}
+
+// The next n bytes, at at.
+inline bool jsonparser::json_binary_decoder::take(size_t n,
+                                                  const unsigned char *&at) {
+  if ((size_t)(end - p) < n)
+    return false;
+  at = p;
+  p += n;
+  return true;
+}
+
+inline bool jsonparser::json_binary_decoder::big_endian(size_t n,
+                                                        uint64_t &value) {
+  const unsigned char *at;
+  if (!take(n, at))
+    return false;
+  value = 0;
+  for (size_t i = 0; i < n; i++)
+    value = value << 8 | at[i];
+  return true;
+}
+
+// A new container, pushed as a frame unless it is already complete.
+jsonparser::jvalue
+jsonparser::json_binary_decoder::open_container(bool object, uint64_t count,
+                                                bool indefinite) {
+  // Every item takes a byte at least, which bounds what a count can reserve.
+  size_t reserve = (size_t)std::min<uint64_t>(count, end - p);
+  jvalue node;
+  if (object) {
+    auto jo = make<json_object>(resource);
+#ifndef CONFIG_ALLOCATOR
+    jo->key_table = key_table;
+#endif
+    jo->keyvalue.reserve(reserve);
+    node = jo;
+  } else {
+    auto ja = make<json_array>(resource);
+    ja->array.reserve(reserve);
+    node = ja;
+  }
+  if (count == 0 && !indefinite)
+    return node;
+  frames.push_back({node, count, object, indefinite, false, json_key()});
+  return nullptr;
+}
+
+jsonparser::jvalue jsonparser::json_binary_decoder::number(json_number num) {
+  return make<json_numeric>(num);
+}
+
+jsonparser::jvalue jsonparser::json_binary_decoder::real(double value) {
+  json_number num;
+  num.type = json_number_type::real;
+  num.d = value;
+  return make<json_numeric>(num);
+}
+
+jsonparser::jvalue jsonparser::json_binary_decoder::keyword(json_token token) {
+  return make<json_state>(token);
+}
+
+jsonparser::jvalue jsonparser::json_binary_decoder::decode(
+    const char *data, size_t size, json_binary_format format) {
+  first = p = (const unsigned char *)data;
+  end = p + size;
+  _error_position = -1;
+  frames.clear();
+
+  while (true) {
+    const unsigned char *at = p;
+    std::string_view key;
+    bool want_key = !frames.empty() && frames.back().object &&
+                    !frames.back().keyed;
+    jvalue value = nullptr;
+    bool ok = format == json_binary_format::cbor
+                  ? cbor_item(value, want_key ? &key : nullptr)
+                  : msgpack_item(value, want_key ? &key : nullptr);
+    if (!ok) {
+      fail(at);
+      return nullptr;
+    }
+
+    if (want_key && key.data()) {
+      frames.back().key = key_table->intern(key);
+      frames.back().keyed = true;
+      continue;
+    }
+    // A container was opened, or a tag skipped.
+    if (!value)
+      continue;
+
+    // Into the enclosing containers, closing each one this completes.
+    while (true) {
+      if (frames.empty()) {
+        if (p != end) {
+          fail(p);
+          return nullptr;
+        }
+        return value;
+      }
+      frame &f = frames.back();
+      if (f.object) {
+        ((json_object *)&*f.node)->keyvalue.push_back({f.key, value});
+        f.keyed = false;
+      } else {
+        ((json_array *)&*f.node)->array.push_back(value);
+      }
+      if (f.indefinite || --f.left)
+        break;
+      value = f.node;
+      frames.pop_back();
+    }
+  }
+}
+
+// The argument of a CBOR head with additional information info.
+bool jsonparser::json_binary_decoder::cbor_argument(unsigned info,
+                                                    uint64_t &n) {
+  if (info < 24) {
+    n = info;
+    return true;
+  }
+  if (info > 27)
+    return false;
+  return big_endian((size_t)1 << (info - 24), n);
+}
+
+// A text or byte string; indefinite ones are joined in scratch.
+bool jsonparser::json_binary_decoder::cbor_string(unsigned major,
+                                                  unsigned info,
+                                                  std::string_view &str) {
+  const unsigned char *at;
+  uint64_t n;
+  if (info != 31) {
+    if (!cbor_argument(info, n) || !take(n, at))
+      return false;
+    str = std::string_view((const char *)at, n);
+    return true;
+  }
+
+  scratch.clear();
+  while (true) {
+    if (!take(1, at))
+      return false;
+    if (*at == 0xff)
+      break;
+    if ((unsigned)(*at >> 5) != major || (*at & 31) == 31)
+      return false;
+    const unsigned char *chunk;
+    if (!cbor_argument(*at & 31, n) || !take(n, chunk))
+      return false;
+    scratch.append((const char *)chunk, n);
+  }
+  str = scratch;
+  return true;
+}
+
+bool jsonparser::json_binary_decoder::cbor_item(jvalue &value,
+                                                std::string_view *key) {
+  const unsigned char *at;
+  if (!take(1, at))
+    return false;
+  unsigned major = *at >> 5, info = *at & 31;
+  uint64_t n;
+
+  // Only a string, or the break of an indefinite map, may stand for a key.
+  if (key && major != 2 && major != 3 && major != 6 && *at != 0xff)
+    return false;
+
+  switch (major) {
+  case 0:
+  case 1: {
+    if (!cbor_argument(info, n))
+      return false;
+    json_number num;
+    if (n > (uint64_t)INT64_MAX && major == 1) {
+      // Below INT64_MIN.
+      value = real(-1.0 - (double)n);
+      return true;
+    }
+    if (n > (uint64_t)INT64_MAX) {
+      num.type = json_number_type::uint64;
+      num.u = n;
+    } else {
+      num.i = major == 0 ? (int64_t)n : -1 - (int64_t)n;
+    }
+    value = number(num);
+    return true;
+  }
+
+  case 2:
+  case 3: {
+    std::string_view str;
+    if (!cbor_string(major, info, str))
+      return false;
+    if (key)
+      *key = str.data() ? str : std::string_view("", 0);
+    else
+      value = make<json_string>(std::pmr::string(str, resource));
+    return true;
+  }
+
+  case 4:
+  case 5:
+    if (info == 31) {
+      value = open_container(major == 5, 0, true);
+      return true;
+    }
+    if (!cbor_argument(info, n))
+      return false;
+    value = open_container(major == 5, n, false);
+    return true;
+
+  case 6:
+    // Tags only annotate the item that follows.
+    return cbor_argument(info, n);
+
+  default:
+    break;
+  }
+
+  switch (info) {
+  case 20:
+    value = keyword(json_token::v_false);
+    return true;
+  case 21:
+    value = keyword(json_token::v_true);
+    return true;
+  case 22:
+  case 23:
+    value = keyword(json_token::v_null);
+    return true;
+  case 25: {
+    if (!big_endian(2, n))
+      return false;
+    int exponent = (n >> 10) & 0x1f, mantissa = n & 0x3ff;
+    double d = exponent == 0    ? std::ldexp(mantissa, -24)
+               : exponent != 31 ? std::ldexp(mantissa + 1024, exponent - 25)
+               : mantissa       ? NAN
+                                : INFINITY;
+    value = real(n & 0x8000 ? -d : d);
+    return true;
+  }
+  case 26: {
+    if (!big_endian(4, n))
+      return false;
+    uint32_t bits = (uint32_t)n;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    value = real(f);
+    return true;
+  }
+  case 27: {
+    if (!big_endian(8, n))
+      return false;
+    double d;
+    memcpy(&d, &n, sizeof(d));
+    value = real(d);
+    return true;
+  }
+  case 31: {
+    // Break: closes the innermost indefinite container, between members.
+    if (frames.empty() || !frames.back().indefinite || frames.back().keyed)
+      return false;
+    value = frames.back().node;
+    frames.pop_back();
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+bool jsonparser::json_binary_decoder::msgpack_item(jvalue &value,
+                                                   std::string_view *key) {
+  const unsigned char *at;
+  if (!take(1, at))
+    return false;
+  unsigned char b = *at;
+  uint64_t n;
+  json_number num;
+
+  // Strings, fixstr through str32, and binary data.
+  size_t length_bytes = 0;
+  bool is_string = true;
+  if ((b & 0xe0) == 0xa0)
+    n = b & 0x1f;
+  else if (b == 0xd9 || b == 0xc4)
+    length_bytes = 1;
+  else if (b == 0xda || b == 0xc5)
+    length_bytes = 2;
+  else if (b == 0xdb || b == 0xc6)
+    length_bytes = 4;
+  else
+    is_string = false;
+
+  if (is_string) {
+    const unsigned char *str;
+    if ((length_bytes && !big_endian(length_bytes, n)) || !take(n, str))
+      return false;
+    std::string_view text((const char *)str, n);
+    if (key)
+      *key = text.data() ? text : std::string_view("", 0);
+    else
+      value = make<json_string>(std::pmr::string(text, resource));
+    return true;
+  }
+  if (key)
+    return false;
+
+  if (b < 0x80 || b >= 0xe0) {
+    num.i = (int8_t)b;
+    value = number(num);
+    return true;
+  }
+  if ((b & 0xf0) == 0x80 || (b & 0xf0) == 0x90) {
+    value = open_container(b < 0x90, b & 0x0f, false);
+    return true;
+  }
+
+  switch (b) {
+  case 0xc0:
+    value = keyword(json_token::v_null);
+    return true;
+  case 0xc2:
+    value = keyword(json_token::v_false);
+    return true;
+  case 0xc3:
+    value = keyword(json_token::v_true);
+    return true;
+
+  case 0xca: {
+    if (!big_endian(4, n))
+      return false;
+    uint32_t bits = (uint32_t)n;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    value = real(f);
+    return true;
+  }
+  case 0xcb: {
+    if (!big_endian(8, n))
+      return false;
+    double d;
+    memcpy(&d, &n, sizeof(d));
+    value = real(d);
+    return true;
+  }
+
+  case 0xcc:
+  case 0xcd:
+  case 0xce:
+  case 0xcf:
+    if (!big_endian((size_t)1 << (b - 0xcc), n))
+      return false;
+    if (n > (uint64_t)INT64_MAX) {
+      num.type = json_number_type::uint64;
+      num.u = n;
+    } else {
+      num.i = (int64_t)n;
+    }
+    value = number(num);
+    return true;
+
+  case 0xd0:
+  case 0xd1:
+  case 0xd2:
+  case 0xd3: {
+    size_t bytes = (size_t)1 << (b - 0xd0);
+    if (!big_endian(bytes, n))
+      return false;
+    // Sign extend from the top bit of the field.
+    unsigned shift = 64 - 8 * bytes;
+    num.i = (int64_t)(n << shift) >> shift;
+    value = number(num);
+    return true;
+  }
+
+  case 0xdc:
+  case 0xdd:
+  case 0xde:
+  case 0xdf:
+    if (!big_endian(b & 1 ? 4 : 2, n))
+      return false;
+    value = open_container(b >= 0xde, n, false);
+    return true;
+
+  default:
+    // Extension types have no JSON counterpart.
+    return false;
+  }
+}
@@ -0,0 +1,172 @@
+#ifndef JSONBINARY_H
+#define JSONBINARY_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "jsonparser.h"
+#include "jsonsax.h"
+
+namespace jsonparser {
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Binary
+///
+///===-----------------------------------------------------------------------===
+
+typedef enum class _json_binary_format {
+  cbor,    // RFC 8949
+  msgpack, // MessagePack
+} json_binary_format;
+
+// Appends the events of json_parser::parse_events() to out as CBOR or
+// MessagePack, without building the document. Integers and floats take the
+// smallest encoding that holds them exactly; integers beyond 64 bits become
+// doubles.
+//
+// Containers get definite lengths, which the events only tell at the close:
+// each is opened with a five byte placeholder, and finish() squeezes every
+// placeholder to the real header in one pass over the output.
+class json_binary_encoder : public json_handler {
+  std::string &out;
+  json_binary_format format;
+  size_t begin;
+
+  struct container {
+    size_t offset; // of the placeholder in out
+    size_t count;  // members or elements
+    bool object;
+  };
+  std::vector<container> containers; // in document order
+  std::vector<size_t> open;          // the unclosed ones, innermost last
+
+  static constexpr size_t placeholder = 5;
+
+  void count_value() {
+    if (!open.empty() && !containers[open.back()].object)
+      containers[open.back()].count++;
+  }
+  void start(bool object);
+  void end() { open.pop_back(); }
+  void head(unsigned major, uint64_t n);
+  size_t container_head(const container &c, char *to) const;
+  void string(std::string_view str);
+  void integer(int64_t value);
+  void unsigned_integer(uint64_t value);
+  void real(double value);
+
+public:
+  json_binary_encoder(std::string &out, json_binary_format format);
+
+  bool on_start_object() {
+    count_value();
+    start(true);
+    return true;
+  }
+  bool on_end_object() {
+    end();
+    return true;
+  }
+  bool on_start_array() {
+    count_value();
+    start(false);
+    return true;
+  }
+  bool on_end_array() {
+    end();
+    return true;
+  }
+  bool on_key(std::string_view key) {
+    containers[open.back()].count++;
+    string(key);
+    return true;
+  }
+  bool on_string(std::string_view str) {
+    count_value();
+    string(str);
+    return true;
+  }
+  bool on_number(const json_number &num, std::string_view text);
+  bool on_bool(bool value);
+  bool on_null();
+
+  // Write the container headers. Call once the parse succeeded; out is
+  // complete after that, and the encoder can take the next document.
+  void finish();
+};
+
+// Builds json_value trees from CBOR or MessagePack. Map keys must be
+// strings; byte strings read as strings, tags are skipped, and the CBOR
+// undefined value reads as null. Nodes live in the decoder's arena, or are
+// reference counted without CONFIG_ALLOCATOR, like those of a json_parser.
+class json_binary_decoder {
+#ifdef CONFIG_ALLOCATOR
+  json_arena _arena;
+#endif
+  std::pmr::memory_resource *resource;
+  std::shared_ptr<json_key_table> key_table;
+
+  const unsigned char *first = nullptr;
+  const unsigned char *p = nullptr;
+  const unsigned char *end = nullptr;
+  long long _error_position = -1;
+  std::string scratch;
+
+  struct frame {
+    jvalue node;
+    uint64_t left; // items still to come, if definite
+    bool object;
+    bool indefinite;
+    bool keyed; // the key of the next member was read
+    json_key key;
+  };
+  std::vector<frame> frames;
+
+#ifdef CONFIG_ALLOCATOR
+  template <typename T, typename... args> T *make(args &&...a) {
+    return _arena.make<T>(std::forward<args>(a)...);
+  }
+#else
+  template <typename T, typename... args>
+  std::shared_ptr<T> make(args &&...a) {
+    return std::make_shared<T>(std::forward<args>(a)...);
+  }
+#endif
+
+  bool take(size_t n, const unsigned char *&at);
+  bool big_endian(size_t n, uint64_t &value);
+  jvalue open_container(bool object, uint64_t count, bool indefinite);
+  jvalue number(json_number num);
+  jvalue real(double value);
+  jvalue keyword(json_token token);
+  bool cbor_argument(unsigned info, uint64_t &n);
+  bool cbor_string(unsigned major, unsigned info, std::string_view &str);
+  bool cbor_item(jvalue &value, std::string_view *key);
+  bool msgpack_item(jvalue &value, std::string_view *key);
+  bool fail(const unsigned char *at);
+
+public:
+  explicit json_binary_decoder(size_t arena_block = 1024 * 4);
+
+  json_binary_decoder(const json_binary_decoder &) = delete;
+  json_binary_decoder &operator=(const json_binary_decoder &) = delete;
+
+  // The single value encoded in [data, data + size), or nullptr if the input
+  // is malformed, see error_position(). Values decoded before stay valid.
+  jvalue decode(const char *data, size_t size, json_binary_format format);
+  jvalue decode(std::string_view data, json_binary_format format) {
+    return decode(data.data(), data.size(), format);
+  }
+
+  // Offset of the item the last decode() failed at, -1 if it succeeded.
+  long long error_position() const { return _error_position; }
+
+  const json_key_table &keys() const { return *key_table; }
+};
+
+} // namespace jsonparser
+
+#endif
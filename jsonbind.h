@@ -0,0 +1,453 @@
+#ifndef JSONBIND_H
+#define JSONBIND_H
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "jsonparser.h"
+
+namespace jsonparser {
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Fields
+///
+///===-----------------------------------------------------------------------===
+
+// A member of a struct and the key it is read from.
+template <typename C, typename M> struct json_field {
+  std::string_view name;
+  M C::*member;
+};
+
+template <typename C, typename M>
+constexpr json_field<C, M> json_bind_field(std::string_view name,
+                                           M C::*member) {
+  return {name, member};
+}
+
+// Declare the members of a struct that json_parser::parse_into() reads, each
+// from the key of the same name:
+//
+//   struct user { std::string name; long long followers; };
+//   JSON_FIELDS(user, name, followers)
+//
+// Goes at namespace scope after the struct, in its namespace; it defines
+// json_bind_fields(const type *), which is found by argument dependent
+// lookup. Up to 32 members.
+#define JSON_FIELDS(type, ...)                                                 \
+  constexpr auto json_bind_fields(const type *) {                              \
+    return std::make_tuple(JSON_BIND_EXPAND(JSON_BIND_CAT(                     \
+        JSON_BIND_F, JSON_BIND_COUNT(__VA_ARGS__))(type, __VA_ARGS__)));       \
+  }
+
+#define JSON_BIND_EXPAND(x) x
+#define JSON_BIND_CAT(a, b) JSON_BIND_CAT_(a, b)
+#define JSON_BIND_CAT_(a, b) a##b
+
+#define JSON_BIND_F1(t, f) jsonparser::json_bind_field(#f, &t::f)
+#define JSON_BIND_F2(t, f, ...)                                                \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F1(t, __VA_ARGS__))
+#define JSON_BIND_F3(t, f, ...)                                                \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F2(t, __VA_ARGS__))
+#define JSON_BIND_F4(t, f, ...)                                                \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F3(t, __VA_ARGS__))
+#define JSON_BIND_F5(t, f, ...)                                                \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F4(t, __VA_ARGS__))
+#define JSON_BIND_F6(t, f, ...)                                                \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F5(t, __VA_ARGS__))
+#define JSON_BIND_F7(t, f, ...)                                                \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F6(t, __VA_ARGS__))
+#define JSON_BIND_F8(t, f, ...)                                                \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F7(t, __VA_ARGS__))
+#define JSON_BIND_F9(t, f, ...)                                                \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F8(t, __VA_ARGS__))
+#define JSON_BIND_F10(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F9(t, __VA_ARGS__))
+#define JSON_BIND_F11(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F10(t, __VA_ARGS__))
+#define JSON_BIND_F12(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F11(t, __VA_ARGS__))
+#define JSON_BIND_F13(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F12(t, __VA_ARGS__))
+#define JSON_BIND_F14(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F13(t, __VA_ARGS__))
+#define JSON_BIND_F15(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F14(t, __VA_ARGS__))
+#define JSON_BIND_F16(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F15(t, __VA_ARGS__))
+#define JSON_BIND_F17(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F16(t, __VA_ARGS__))
+#define JSON_BIND_F18(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F17(t, __VA_ARGS__))
+#define JSON_BIND_F19(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F18(t, __VA_ARGS__))
+#define JSON_BIND_F20(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F19(t, __VA_ARGS__))
+#define JSON_BIND_F21(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F20(t, __VA_ARGS__))
+#define JSON_BIND_F22(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F21(t, __VA_ARGS__))
+#define JSON_BIND_F23(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F22(t, __VA_ARGS__))
+#define JSON_BIND_F24(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F23(t, __VA_ARGS__))
+#define JSON_BIND_F25(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F24(t, __VA_ARGS__))
+#define JSON_BIND_F26(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F25(t, __VA_ARGS__))
+#define JSON_BIND_F27(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F26(t, __VA_ARGS__))
+#define JSON_BIND_F28(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F27(t, __VA_ARGS__))
+#define JSON_BIND_F29(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F28(t, __VA_ARGS__))
+#define JSON_BIND_F30(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F29(t, __VA_ARGS__))
+#define JSON_BIND_F31(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F30(t, __VA_ARGS__))
+#define JSON_BIND_F32(t, f, ...)                                               \
+  JSON_BIND_F1(t, f), JSON_BIND_EXPAND(JSON_BIND_F31(t, __VA_ARGS__))
+
+#define JSON_BIND_NTH(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12,       \
+    _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, _26,      \
+    _27, _28, _29, _30, _31, _32, n, ...) n
+#define JSON_BIND_COUNT(...) JSON_BIND_EXPAND(JSON_BIND_NTH(__VA_ARGS__,       \
+    32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15,    \
+    14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1))
+
+// Whether T was declared with JSON_FIELDS.
+template <typename T, typename = void> struct json_is_bound : std::false_type {};
+template <typename T>
+struct json_is_bound<
+    T, std::void_t<decltype(json_bind_fields((const T *)nullptr))>>
+    : std::true_type {};
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Key Map
+///
+///===-----------------------------------------------------------------------===
+
+// Field names to indices, built at compile time: an open addressing table
+// hashed on the length and the first, middle and last byte of a key. The
+// multiplier is searched for one that gives every name a slot of its own, so
+// a lookup costs a multiply and a single compare; names alike in all four
+// still work, probing on.
+template <size_t N> class json_key_map {
+  static constexpr size_t bits = [] {
+    size_t b = 1;
+    while ((size_t(1) << b) < 2 * N)
+      b++;
+    return b;
+  }();
+  static constexpr size_t size = size_t(1) << bits;
+
+  std::array<std::string_view, N> names{};
+  std::array<uint16_t, size> slots{}; // index + 1, 0 if free
+  uint64_t multiplier = 0;
+
+  static constexpr uint64_t mix(std::string_view key) {
+    size_t n = key.size();
+    uint64_t h = n;
+    if (n)
+      h |= (uint64_t)(uint8_t)key[0] << 32 |
+           (uint64_t)(uint8_t)key[n / 2] << 40 |
+           (uint64_t)(uint8_t)key[n - 1] << 48;
+    return h;
+  }
+  constexpr size_t slot(std::string_view key, uint64_t m) const {
+    return (size_t)((mix(key) * m) >> (64 - bits));
+  }
+
+public:
+  constexpr json_key_map(const std::array<std::string_view, N> &keys)
+      : names(keys) {
+    static_assert(N < 0xffff, "too many fields");
+    size_t best = N + 1;
+    for (uint64_t seed = 0; seed < 64 && best; seed++) {
+      uint64_t m = (0x9e3779b97f4a7c15ULL + seed * 0xbf58476d1ce4e5b9ULL) | 1;
+      std::array<bool, size> used{};
+      size_t collisions = 0;
+      for (size_t i = 0; i < N; i++) {
+        size_t s = slot(names[i], m);
+        collisions += used[s];
+        used[s] = true;
+      }
+      if (collisions < best) {
+        best = collisions;
+        multiplier = m;
+      }
+    }
+    for (size_t i = 0; i < N; i++) {
+      size_t s = slot(names[i], multiplier);
+      while (slots[s])
+        s = (s + 1) & (size - 1);
+      slots[s] = (uint16_t)(i + 1);
+    }
+  }
+
+  // Index of the field named key, -1 if there is none.
+  int find(std::string_view key) const {
+    for (size_t s = slot(key, multiplier); slots[s]; s = (s + 1) & (size - 1))
+      if (names[slots[s] - 1] == key)
+        return slots[s] - 1;
+    return -1;
+  }
+};
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Bind Reader
+///
+///===-----------------------------------------------------------------------===
+
+// Recursive descent over the lexer's tokens, specialized for the target type
+// at compile time. Values land in their members directly; keys that no field
+// takes are skipped, see json_lexer::skip_value().
+//
+// Reads bool, integers (range checked, reals are refused), floating point,
+// std::string, std::optional (null resets it), std::vector, and structs
+// declared with JSON_FIELDS. Members whose key is missing keep their value.
+class json_bind_reader {
+  json_lexer &lex;
+  std::string &scratch;
+  size_t depth = 0;
+
+  template <typename T> bool read_object(T &out);
+  template <typename T> bool read_array(std::vector<T> &out);
+  template <typename T> bool read_integer(T &out);
+
+public:
+  // Nesting allowed for recursive types.
+  static constexpr size_t max_depth = 1024;
+
+  json_bind_reader(json_lexer &lex, std::string &scratch)
+      : lex(lex), scratch(scratch) {}
+
+  // Read the value starting at the current token. The value's last token is
+  // current afterwards.
+  template <typename T> bool read(T &out);
+};
+
+// Per type tables of a struct declared with JSON_FIELDS.
+template <typename T> struct json_bind_table {
+  static constexpr auto fields = json_bind_fields((const T *)nullptr);
+  static constexpr size_t count =
+      std::tuple_size<std::decay_t<decltype(fields)>>::value;
+
+  using reader = bool (*)(json_bind_reader &, T &);
+
+  template <size_t I> static bool read_field(json_bind_reader &r, T &out) {
+    return r.read(out.*(std::get<I>(fields).member));
+  }
+  template <size_t... I>
+  static constexpr std::array<std::string_view, count>
+  names(std::index_sequence<I...>) {
+    return {std::get<I>(fields).name...};
+  }
+  template <size_t... I>
+  static constexpr std::array<reader, count>
+  readers(std::index_sequence<I...>) {
+    return {&read_field<I>...};
+  }
+
+  static constexpr json_key_map<count> keys{
+      names(std::make_index_sequence<count>())};
+  static constexpr std::array<reader, count> read_fields =
+      readers(std::make_index_sequence<count>());
+};
+
+template <typename T> struct json_is_vector : std::false_type {};
+template <typename T, typename A>
+struct json_is_vector<std::vector<T, A>> : std::true_type {};
+
+template <typename T> struct json_is_optional : std::false_type {};
+template <typename T>
+struct json_is_optional<std::optional<T>> : std::true_type {};
+
+inline bool json_value_starts(json_token token) {
+  switch (token) {
+  case json_token::object_starts:
+  case json_token::array_starts:
+  case json_token::v_string:
+  case json_token::v_number:
+  case json_token::v_true:
+  case json_token::v_false:
+  case json_token::v_null:
+    return true;
+  default:
+    return false;
+  }
+}
+
+template <typename T> bool json_bind_reader::read(T &out) {
+  if constexpr (std::is_same_v<T, bool>) {
+    if (lex.type() != json_token::v_true && lex.type() != json_token::v_false)
+      return false;
+    out = lex.type() == json_token::v_true;
+    return true;
+  } else if constexpr (std::is_integral_v<T>) {
+    return read_integer(out);
+  } else if constexpr (std::is_floating_point_v<T>) {
+    if (lex.type() != json_token::v_number)
+      return false;
+    out = (T)lex.number().as_double();
+    return true;
+  } else if constexpr (std::is_same_v<T, std::string>) {
+    return lex.type() == json_token::v_string && lex.materialize(out);
+  } else if constexpr (json_is_optional<T>::value) {
+    if (lex.type() == json_token::v_null) {
+      out.reset();
+      return true;
+    }
+    return read(out.emplace());
+  } else if constexpr (json_is_vector<T>::value) {
+    return read_array(out);
+  } else if constexpr (json_is_bound<T>::value) {
+    return read_object(out);
+  } else {
+    static_assert(json_is_bound<T>::value,
+                  "type can't be read, declare it with JSON_FIELDS");
+    return false;
+  }
+}
+
+template <typename T> bool json_bind_reader::read_integer(T &out) {
+  if (lex.type() != json_token::v_number)
+    return false;
+  const json_number &num = lex.number();
+  using limits = std::numeric_limits<T>;
+  if (num.type == json_number_type::int64) {
+    if constexpr (std::is_signed_v<T>) {
+      if (num.i < (int64_t)limits::min() || num.i > (int64_t)limits::max())
+        return false;
+    } else {
+      if (num.i < 0 || (uint64_t)num.i > (uint64_t)limits::max())
+        return false;
+    }
+    out = (T)num.i;
+    return true;
+  }
+  if (num.type == json_number_type::uint64 &&
+      num.u <= (uint64_t)limits::max()) {
+    out = (T)num.u;
+    return true;
+  }
+  // Decoded as a real, to keep its sign.
+  if (lex.view() == "-0") {
+    out = 0;
+    return true;
+  }
+  return false;
+}
+
+template <typename T>
+bool json_bind_reader::read_array(std::vector<T> &out) {
+  if (lex.type() != json_token::array_starts || ++depth > max_depth)
+    return false;
+  out.clear();
+  if (!lex.next())
+    return false;
+  if (lex.type() != json_token::array_ends) {
+    while (true) {
+      if constexpr (std::is_same_v<T, bool>) {
+        bool value;
+        if (!read(value))
+          return false;
+        out.push_back(value);
+      } else if (!read(out.emplace_back())) {
+        return false;
+      }
+      if (!lex.next())
+        return false;
+      if (lex.type() == json_token::array_ends)
+        break;
+      if (lex.type() != json_token::v_comma || !lex.next())
+        return false;
+    }
+  }
+  depth--;
+  return true;
+}
+
+template <typename T> bool json_bind_reader::read_object(T &out) {
+  using table = json_bind_table<T>;
+  if (lex.type() != json_token::object_starts || ++depth > max_depth)
+    return false;
+  if (!lex.next())
+    return false;
+  if (lex.type() != json_token::object_ends) {
+    while (true) {
+      if (lex.type() != json_token::v_string)
+        return false;
+      // The key is looked up before the next token can move the window.
+      std::string_view key = lex.view();
+      if (lex.span().flags & (span_escaped | span_invalid)) {
+        if (!lex.materialize(scratch))
+          return false;
+        key = scratch;
+      }
+      int field = table::keys.find(key);
+
+      if (!lex.next() || lex.type() != json_token::v_pair || !lex.next() ||
+          !json_value_starts(lex.type()))
+        return false;
+      if (field < 0 ? !lex.skip_value() : !table::read_fields[field](*this, out))
+        return false;
+
+      if (!lex.next())
+        return false;
+      if (lex.type() == json_token::object_ends)
+        break;
+      if (lex.type() != json_token::v_comma || !lex.next())
+        return false;
+    }
+  }
+  depth--;
+  return true;
+}
+
+// Like parse(), a document at a time in a sequence().
+template <typename T> bool json_parser::parse_into(T &out) {
+  // Nothing is built for a filter to select, and a token cut by pushed input
+  // can't be lexed again once it was read into out.
+  if (filtering || lex.starving()) {
+    _error = true;
+    return false;
+  }
+
+  if (!_following && !lex.next()) {
+    _error = true;
+    return false;
+  }
+  _following = false;
+
+  json_bind_reader reader(lex, scratch);
+  if (!reader.read(out) || !lex.next()) {
+    _error = true;
+    return false;
+  }
+  // The next document's first token, or eof, is current now.
+  if (_sequence) {
+    _following = true;
+    return true;
+  }
+  if (lex.type() != json_token::eof) {
+    _error = true;
+    return false;
+  }
+  return true;
+}
+
+} // namespace jsonparser
+
+#endif
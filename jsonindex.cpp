@@ -0,0 +1,274 @@
+#include "jsonindex.h"
+#include <algorithm>
+#include <memory.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CONFIG_INDEX_X86
+#endif
+
+///===-----------------------------------------------------------------------===
+///
+///               Classification
+///
+///===-----------------------------------------------------------------------===
+
+// Every 64 byte chunk produces four masks, in this order.
+enum { mask_quote, mask_backslash, mask_space, mask_operator, mask_count };
+
+using classify_fn = void (*)(const char *, size_t, uint64_t *);
+
+static unsigned char class_table[256];
+
+static bool init_class_table() {
+  class_table[(unsigned char)'"'] = 1 << mask_quote;
+  class_table[(unsigned char)'\\'] = 1 << mask_backslash;
+  for (auto c : {' ', '\t', '\n', '\r'})
+    class_table[(unsigned char)c] = 1 << mask_space;
+  for (auto c : {'{', '}', '[', ']', ':', ','})
+    class_table[(unsigned char)c] = 1 << mask_operator;
+  return true;
+}
+
+static bool class_table_ready = init_class_table();
+
+static void classify_scalar(const char *data, size_t chunks, uint64_t *masks) {
+  for (size_t i = 0; i < chunks; i++, data += 64, masks += mask_count) {
+    uint64_t m[mask_count] = {0, 0, 0, 0};
+    for (int j = 0; j < 64; j++) {
+      unsigned char c = class_table[(unsigned char)data[j]];
+      for (int k = 0; k < mask_count; k++)
+        m[k] |= (uint64_t)((c >> k) & 1) << j;
+    }
+    memcpy(masks, m, sizeof(m));
+  }
+}
+
+#ifdef CONFIG_INDEX_X86
+
+// '[' and ']' differ from '{' and '}' only in bit 0x20, so or-ing it in folds
+// the four brackets onto two comparisons.
+
+__attribute__((target("sse4.2"))) static void
+classify_sse42(const char *data, size_t chunks, uint64_t *masks) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i lf = _mm_set1_epi8('\n');
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i fold = _mm_set1_epi8(0x20);
+  const __m128i lbrace = _mm_set1_epi8('{');
+  const __m128i rbrace = _mm_set1_epi8('}');
+  const __m128i colon = _mm_set1_epi8(':');
+  const __m128i comma = _mm_set1_epi8(',');
+
+  for (size_t i = 0; i < chunks; i++, data += 64, masks += mask_count) {
+    uint64_t m[mask_count] = {0, 0, 0, 0};
+    for (int j = 0; j < 4; j++) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(data + j * 16));
+      __m128i f = _mm_or_si128(v, fold);
+      __m128i ws = _mm_or_si128(
+          _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+          _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+      __m128i op = _mm_or_si128(
+          _mm_or_si128(_mm_cmpeq_epi8(f, lbrace), _mm_cmpeq_epi8(f, rbrace)),
+          _mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, comma)));
+      int shift = j * 16;
+      m[mask_quote] |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+                           _mm_cmpeq_epi8(v, quote))
+                       << shift;
+      m[mask_backslash] |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+                               _mm_cmpeq_epi8(v, backslash))
+                           << shift;
+      m[mask_space] |= (uint64_t)(uint16_t)_mm_movemask_epi8(ws) << shift;
+      m[mask_operator] |= (uint64_t)(uint16_t)_mm_movemask_epi8(op) << shift;
+    }
+    memcpy(masks, m, sizeof(m));
+  }
+}
+
+__attribute__((target("avx2"))) static void
+classify_avx2(const char *data, size_t chunks, uint64_t *masks) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i lf = _mm256_set1_epi8('\n');
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i fold = _mm256_set1_epi8(0x20);
+  const __m256i lbrace = _mm256_set1_epi8('{');
+  const __m256i rbrace = _mm256_set1_epi8('}');
+  const __m256i colon = _mm256_set1_epi8(':');
+  const __m256i comma = _mm256_set1_epi8(',');
+
+  for (size_t i = 0; i < chunks; i++, data += 64, masks += mask_count) {
+    uint64_t m[mask_count] = {0, 0, 0, 0};
+    for (int j = 0; j < 2; j++) {
+      __m256i v = _mm256_loadu_si256((const __m256i *)(data + j * 32));
+      __m256i f = _mm256_or_si256(v, fold);
+      __m256i ws = _mm256_or_si256(
+          _mm256_or_si256(_mm256_cmpeq_epi8(v, space),
+                          _mm256_cmpeq_epi8(v, tab)),
+          _mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr)));
+      __m256i op = _mm256_or_si256(
+          _mm256_or_si256(_mm256_cmpeq_epi8(f, lbrace),
+                          _mm256_cmpeq_epi8(f, rbrace)),
+          _mm256_or_si256(_mm256_cmpeq_epi8(v, colon),
+                          _mm256_cmpeq_epi8(v, comma)));
+      int shift = j * 32;
+      m[mask_quote] |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                           _mm256_cmpeq_epi8(v, quote))
+                       << shift;
+      m[mask_backslash] |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                               _mm256_cmpeq_epi8(v, backslash))
+                           << shift;
+      m[mask_space] |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << shift;
+      m[mask_operator] |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op)
+                          << shift;
+    }
+    memcpy(masks, m, sizeof(m));
+  }
+}
+#endif
+
+static jsonparser::json_structural_index::isa detect_isa() {
+#ifdef CONFIG_INDEX_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return jsonparser::json_structural_index::isa::avx2;
+  if (__builtin_cpu_supports("sse4.2"))
+    return jsonparser::json_structural_index::isa::sse42;
+#endif
+  return jsonparser::json_structural_index::isa::scalar;
+}
+
+static const jsonparser::json_structural_index::isa detected_isa =
+    detect_isa();
+static jsonparser::json_structural_index::isa active_isa = detected_isa;
+
+static classify_fn classifier(jsonparser::json_structural_index::isa target) {
+  switch (target) {
+#ifdef CONFIG_INDEX_X86
+  case jsonparser::json_structural_index::isa::avx2:
+    return classify_avx2;
+  case jsonparser::json_structural_index::isa::sse42:
+    return classify_sse42;
+#endif
+  default:
+    return classify_scalar;
+  }
+}
+
+static classify_fn active_classifier = classifier(active_isa);
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Structural Index
+///
+///===-----------------------------------------------------------------------===
+
+static inline uint64_t prefix_xor(uint64_t x) {
+  x ^= x << 1;
+  x ^= x << 2;
+  x ^= x << 4;
+  x ^= x << 8;
+  x ^= x << 16;
+  x ^= x << 32;
+  return x;
+}
+
+jsonparser::json_structural_index::json_structural_index() {}
+
+// Room for size bytes, in whole chunks. Grows geometrically up to slice_size.
+void jsonparser::json_structural_index::reserve(size_t size) {
+  size_t chunks = std::max((size + 63) / 64, capacity / 64 * 2);
+  capacity = std::min(chunks * 64, slice_size);
+  masks.reset(new uint64_t[capacity / 64 * mask_count]);
+  out.reset(new uint32_t[capacity]);
+}
+
+void jsonparser::json_structural_index::reset() {
+  prev_in_string = 0;
+  prev_escaped = 0;
+  prev_scalar = 0;
+  out_count = 0;
+}
+
+size_t jsonparser::json_structural_index::build(const char *data,
+                                                size_t size) {
+  if (size > capacity)
+    reserve(size);
+
+  size_t full = size / 64;
+  size_t rest = size % 64;
+
+  active_classifier(data, full, masks.get());
+  if (rest) {
+    // Pad the tail with whitespace, which is never structural.
+    char pad[64];
+    memset(pad, ' ', sizeof(pad));
+    memcpy(pad, data + full * 64, rest);
+    active_classifier(pad, 1, masks.get() + full * mask_count);
+  }
+
+  const uint64_t even_bits = 0x5555555555555555ULL;
+  size_t chunks = full + (rest ? 1 : 0);
+  uint32_t *dst = out.get();
+
+  for (size_t i = 0; i < chunks; i++) {
+    const uint64_t *m = masks.get() + i * mask_count;
+
+    // A backslash escapes the next byte, unless it is escaped itself: find
+    // the odd length runs of backslashes and mark the byte after each.
+    uint64_t backslash = m[mask_backslash] & ~prev_escaped;
+    uint64_t follows_escape = backslash << 1 | prev_escaped;
+    uint64_t odd_starts = backslash & ~even_bits & ~follows_escape;
+    uint64_t even_starts;
+    prev_escaped = __builtin_add_overflow(odd_starts, backslash, &even_starts);
+    uint64_t escaped = (even_bits ^ (even_starts << 1)) & follows_escape;
+
+    // Bits from an opening quote up to, not including, its closing quote.
+    uint64_t quote = m[mask_quote] & ~escaped;
+    uint64_t in_string = prefix_xor(quote) ^ prev_in_string;
+    prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+
+    // First byte of every run of number/keyword bytes.
+    uint64_t scalar = ~(m[mask_operator] | m[mask_space] | quote) & ~in_string;
+    uint64_t starts = scalar & ~(scalar << 1 | prev_scalar);
+    prev_scalar = scalar >> 63;
+
+    uint64_t bits = (m[mask_operator] & ~in_string) | quote | starts;
+    uint32_t base = (uint32_t)(i * 64);
+    while (bits) {
+      *dst++ = base + __builtin_ctzll(bits);
+      bits &= bits - 1;
+    }
+  }
+
+  return out_count = dst - out.get();
+}
+
+jsonparser::json_structural_index::isa
+jsonparser::json_structural_index::active() {
+  return active_isa;
+}
+
+void jsonparser::json_structural_index::force(isa target) {
+  // Never select an instruction set the processor lacks.
+  if (target > detected_isa)
+    target = detected_isa;
+  active_isa = target;
+  active_classifier = classifier(target);
+}
+
+const char *jsonparser::json_structural_index::name(isa target) {
+  switch (target) {
+  case isa::avx2:
+    return "avx2";
+  case isa::sse42:
+    return "sse4.2";
+  default:
+    return "scalar";
+  }
+}
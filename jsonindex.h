@@ -0,0 +1,69 @@
+#ifndef JSONINDEX_H
+#define JSONINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace jsonparser {
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Structural Index
+///
+///===-----------------------------------------------------------------------===
+
+// First lexing stage. A slice of input is classified 64 bytes at a time into
+// quote, backslash, whitespace and operator bitmasks (AVX2, SSE4.2 or scalar,
+// picked at runtime). Escapes and string regions are then resolved with plain
+// bit arithmetic, and the offsets of all structural characters are emitted:
+// operators outside strings, the opening and closing quote of every string and
+// the first byte of every number or keyword.
+//
+// String and escape state is carried from one build() to the next, so a
+// document may be indexed in consecutive slices.
+class json_structural_index {
+public:
+  enum class isa { scalar, sse42, avx2 };
+
+  // Largest slice accepted by build(). Multiple of 64.
+  static constexpr size_t slice_size = 1024 * 16;
+
+  json_structural_index();
+
+  // Index [data, data + size), size <= slice_size. Offsets are relative to
+  // data. Returns the number of offsets.
+  size_t build(const char *data, size_t size);
+
+  // Forget the carried state. Must be called whenever indexing restarts at a
+  // new position, which has to be outside any string.
+  void reset();
+
+  const uint32_t *offsets() const { return out.get(); }
+  size_t count() const { return out_count; }
+
+  // True if the last build() ended inside a string.
+  bool in_string() const { return prev_in_string != 0; }
+
+  static isa active();
+  static void force(isa target);
+  static const char *name(isa target);
+
+private:
+  uint64_t prev_in_string = 0;
+  uint64_t prev_escaped = 0;
+  uint64_t prev_scalar = 0;
+
+  // Sized by the largest slice built so far, and not cleared: a lexer on a
+  // short message only pays for what it indexes.
+  std::unique_ptr<uint64_t[]> masks;
+  std::unique_ptr<uint32_t[]> out;
+  size_t capacity = 0;
+  size_t out_count = 0;
+
+  void reserve(size_t size);
+};
+
+} // namespace jsonparser
+
+#endif
@@ -0,0 +1,500 @@
+#include "jsonlines.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory.h>
+#include <stdexcept>
+#include <thread>
+
+#ifdef CONFIG_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Input
+///
+///===-----------------------------------------------------------------------===
+
+static inline bool is_blank(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Run task(i) for every i in [0, count) on up to threads threads, the calling
+// one included.
+static void parallel_for(unsigned threads, size_t count,
+                         const std::function<void(size_t)> &task) {
+  std::atomic<size_t> next(0);
+  auto worker = [&] {
+    for (size_t i; (i = next++) < count;)
+      task(i);
+  };
+
+  std::vector<std::thread> pool;
+  for (size_t t = 1; t < std::min<size_t>(threads, count); t++)
+    pool.emplace_back(worker);
+  worker();
+  for (auto &t : pool)
+    t.join();
+}
+
+static unsigned thread_count(unsigned threads) {
+  return threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+jsonparser::json_input::json_input(const std::string &file_path) {
+  // Compressed input has to be inflated whole before it can be split.
+  if (json_file_compression(file_path) != json_compression::none) {
+    auto source = json_open_source(file_path);
+    const long long block = 1024 * 1024 * 4;
+    long long count = block;
+    while (count == block) {
+      size_t used = owned.size();
+      owned.resize(used + block);
+      count = source->read(&owned[used], block);
+      if (count < 0)
+        throw std::runtime_error("corrupt compressed input!");
+      owned.resize(used + count);
+    }
+    _data = owned.data();
+    _size = owned.size();
+    return;
+  }
+
+#ifdef CONFIG_MMAP
+  int fd = open(file_path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("file not found!");
+
+  struct stat st;
+  if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      // Read concurrently in pieces, not front to back.
+      madvise(addr, st.st_size, MADV_WILLNEED);
+      _data = (const char *)addr;
+      _size = st.st_size;
+      mapped = true;
+    }
+  }
+  close(fd);
+#endif
+
+  if (!mapped) {
+    std::ifstream ifs(file_path, std::ios::binary);
+    if (!ifs)
+      throw std::runtime_error("file not found!");
+    owned.assign(std::istreambuf_iterator<char>(ifs),
+                 std::istreambuf_iterator<char>());
+    _data = owned.data();
+    _size = owned.size();
+  }
+}
+
+jsonparser::json_input::json_input(const char *data, size_t size,
+                                   json_buffer_mode mode) {
+  if (mode == json_buffer_mode::copy) {
+    owned.assign(data, size);
+    data = owned.data();
+  }
+  _data = data;
+  _size = size;
+}
+
+jsonparser::json_input::~json_input() {
+#ifdef CONFIG_MMAP
+  if (mapped)
+    munmap((void *)_data, _size);
+#endif
+}
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Lines
+///
+///===-----------------------------------------------------------------------===
+
+struct jsonparser::json_lines_reader::chunk {
+  const char *begin;
+  size_t size;
+  size_t first_line = 0; // 1-based line of begin
+  size_t newlines = 0;
+  std::unique_ptr<json_parser> parser; // owns the nodes of docs
+  std::vector<jvalue> docs;
+  size_t error_line = 0;
+};
+
+// A chunk holds about chunk_size bytes of input; its arena starts with a block
+// of this many bytes and grows from there.
+static constexpr size_t arena_block = 1024 * 64;
+
+jsonparser::json_lines_reader::json_lines_reader(std::string file_path,
+                                                 unsigned threads)
+    : input(file_path), workers(thread_count(threads)) {
+  split();
+}
+
+jsonparser::json_lines_reader::json_lines_reader(const char *data, size_t size,
+                                                 json_buffer_mode mode,
+                                                 unsigned threads)
+    : input(data, size, mode), workers(thread_count(threads)) {
+  split();
+}
+
+jsonparser::json_lines_reader::~json_lines_reader() {
+  // Documents point into the chunks' parsers; drop them first.
+  docs.clear();
+  chunks.clear();
+}
+
+void jsonparser::json_lines_reader::filter(json_path_filter filter_paths) {
+  paths = std::move(filter_paths);
+}
+
+// Cut the input after the first newline past every chunk_size bytes.
+void jsonparser::json_lines_reader::split() {
+  const char *p = input.data(), *end = p + input.size();
+  while (p != end) {
+    const char *cut = end;
+    if ((size_t)(end - p) > chunk_size) {
+      auto nl = (const char *)memchr(p + chunk_size, '\n',
+                                     end - p - chunk_size);
+      if (nl)
+        cut = nl + 1;
+    }
+    chunks.emplace_back();
+    chunks.back().begin = p;
+    chunks.back().size = cut - p;
+    p = cut;
+  }
+}
+
+bool jsonparser::json_lines_reader::parse() { return run(nullptr); }
+
+bool jsonparser::json_lines_reader::parse(
+    const std::function<void(size_t line, jvalue doc)> &sink) {
+  return run(&sink);
+}
+
+bool jsonparser::json_lines_reader::run(
+    const std::function<void(size_t line, jvalue doc)> *sink) {
+  // Line numbers first: count each chunk's newlines, then add them up.
+  parallel_for(workers, chunks.size(), [&](size_t i) {
+    chunk &c = chunks[i];
+    const char *p = c.begin, *end = c.begin + c.size;
+    c.newlines = 0;
+    while ((p = (const char *)memchr(p, '\n', end - p))) {
+      c.newlines++;
+      p++;
+    }
+  });
+  size_t line = 1;
+  for (auto &c : chunks) {
+    c.first_line = line;
+    line += c.newlines;
+  }
+
+  // Chunks are taken in order, so once one fails the later ones can't hold
+  // the first error and are left alone.
+  std::atomic<size_t> failed(chunks.size());
+  parallel_for(workers, chunks.size(), [&](size_t i) {
+    if (i > failed)
+      return;
+    parse_chunk(chunks[i], sink);
+    if (chunks[i].error_line) {
+      size_t seen = failed;
+      while (i < seen && !failed.compare_exchange_weak(seen, i))
+        ;
+    }
+  });
+
+  docs.clear();
+  _error_line = failed < chunks.size() ? chunks[failed].error_line : 0;
+  if (!sink)
+    for (size_t i = 0; i < chunks.size() && i <= failed; i++)
+      docs.insert(docs.end(), chunks[i].docs.begin(), chunks[i].docs.end());
+  return _error_line == 0;
+}
+
+void jsonparser::json_lines_reader::parse_chunk(
+    chunk &c, const std::function<void(size_t line, jvalue doc)> *sink) {
+  const char *end = c.begin + c.size;
+  const char *doc = std::find_if_not(c.begin, end, is_blank);
+  if (doc == end)
+    return;
+
+  c.parser = std::make_unique<json_parser>(c.begin, c.size,
+                                           json_buffer_mode::borrow,
+                                           arena_block);
+  json_parser &ps = *c.parser;
+  ps.sequence() = true;
+  ps.utf8() = _utf8;
+  if (!paths.empty())
+    ps.filter(paths);
+
+  // Line of at, counting forward from the last call.
+  const char *scan = c.begin;
+  size_t line = c.first_line;
+  auto line_of = [&](const char *at) {
+    while (const char *nl = (const char *)memchr(scan, '\n', at - scan)) {
+      line++;
+      scan = nl + 1;
+    }
+    return line;
+  };
+
+  while (true) {
+    size_t doc_line = line_of(doc);
+    if (!ps.parse()) {
+      // A document may not run past its line: unless that line alone holds
+      // one, it is the culprit. Otherwise it's the line of position(), the
+      // bad token.
+      const char *eol = (const char *)memchr(doc, '\n', end - doc);
+      json_parser alone(doc, (eol ? eol : end) - doc,
+                        json_buffer_mode::borrow, 256);
+      alone.utf8() = _utf8;
+      if (!alone.parse()) {
+        c.error_line = doc_line;
+        return;
+      }
+      c.error_line = line_of(c.begin + std::min<size_t>(ps.position(), c.size));
+      return;
+    }
+
+    // The lookahead is the first token of the next document, or eof, and
+    // only blanks come before it. This document has to end on the line it
+    // starts on, as a chunk boundary could cut it otherwise, and the next
+    // one has to start on a later line.
+    const char *next = ps.more() ? c.begin + ps.token_position() : end;
+    const char *last = next;
+    while (last != doc && is_blank(last[-1]))
+      last--;
+    bool one_line = line_of(last) == doc_line &&
+                    (next == end || line_of(next) != doc_line);
+    if (!one_line) {
+      c.error_line = doc_line;
+      return;
+    }
+
+    if (sink)
+      (*sink)(doc_line, ps.entry());
+    else
+      c.docs.push_back(ps.entry());
+
+    if (!ps.more())
+      break;
+    doc = next;
+  }
+
+  // Streamed documents are gone, so are their nodes.
+  if (sink)
+    c.parser.reset();
+}
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Array Reader
+///
+///===-----------------------------------------------------------------------===
+
+struct jsonparser::json_array_reader::segment {
+  const char *begin;
+  size_t size;
+  bool open, close; // brackets implied, see json_parser::fragment()
+  std::unique_ptr<json_parser> parser;
+  long long error = -1; // offset in the input
+
+  segment(const char *begin, size_t size, bool open, bool close)
+      : begin(begin), size(size), open(open), close(close) {}
+};
+
+// What a scan of one slice of a big array learns, assuming it starts outside
+// any string.
+struct array_scan {
+  bool in_string = false; // ends inside a string
+  long depth = 0;         // opened minus closed brackets
+  // The first comma at depth -d relative to the start, for d below
+  // max_depth. A split point once the absolute depth is known.
+  static constexpr size_t max_depth = 64;
+  const char *comma[max_depth] = {};
+};
+
+static const struct bracket_table {
+  signed char delta[256] = {};
+  constexpr bracket_table() {
+    delta['['] = delta['{'] = 1;
+    delta[']'] = delta['}'] = -1;
+  }
+  int operator[](unsigned char c) const { return delta[c]; }
+} bracket_depth;
+
+static void scan_slice(const char *p, const char *end, array_scan &scan) {
+  using jsonparser::json_structural_index;
+  json_structural_index index;
+  scan = array_scan();
+
+  for (; p < end; p += json_structural_index::slice_size) {
+    size_t size = std::min<size_t>(end - p, json_structural_index::slice_size);
+    size_t count = index.build(p, size);
+    const uint32_t *offsets = index.offsets();
+    for (size_t i = 0; i < count; i++) {
+      // Most offsets are quotes and scalars: keep the depth without
+      // branching on them.
+      const char *at = p + offsets[i];
+      scan.depth += bracket_depth[(unsigned char)*at];
+      if (*at == ',' && scan.depth <= 0 &&
+          -scan.depth < (long)array_scan::max_depth &&
+          !scan.comma[-scan.depth])
+        scan.comma[-scan.depth] = at;
+    }
+  }
+  scan.in_string = index.in_string();
+}
+
+// First byte past the string that p is inside of, or end. p must not be
+// escaped.
+static const char *string_end(const char *p, const char *end) {
+  for (; p < end; p++) {
+    if (*p == '\\')
+      p++;
+    else if (*p == '"')
+      return p + 1;
+  }
+  return end;
+}
+
+jsonparser::json_array_reader::json_array_reader(std::string file_path,
+                                                 unsigned threads)
+    : input(file_path), workers(thread_count(threads)) {
+  split();
+}
+
+jsonparser::json_array_reader::json_array_reader(const char *data, size_t size,
+                                                 json_buffer_mode mode,
+                                                 unsigned threads)
+    : input(data, size, mode), workers(thread_count(threads)) {
+  split();
+}
+
+jsonparser::json_array_reader::~json_array_reader() = default;
+
+size_t jsonparser::json_array_reader::segments() const {
+  return pieces.size();
+}
+
+// Cut the input at commas between top-level elements, about chunk_size bytes
+// apart. Slices of the input are scanned in parallel as if each began outside
+// a string; the quote parity of the slices before tells which really did, and
+// those are scanned again from their first closing quote. Bracket depths add
+// up the same way and pick each slice's split comma.
+void jsonparser::json_array_reader::split() {
+  const char *data = input.data(), *end = data + input.size();
+  const char *first = std::find_if_not(data, end, is_blank);
+  if (input.size() < 2 * chunk_size || first == end || *first != '[') {
+    pieces.emplace_back(data, input.size(), false, false);
+    return;
+  }
+
+  // Slices never start on an escaped byte, so the index needs no carried
+  // escape state.
+  std::vector<const char *> starts = {data};
+  for (const char *p = data + chunk_size; p < end; p += chunk_size) {
+    while (p < end && p[-1] == '\\')
+      p++;
+    if (p < end)
+      starts.push_back(p);
+  }
+  size_t count = starts.size();
+  starts.push_back(end);
+
+  std::vector<array_scan> scans(count);
+  parallel_for(workers, count, [&](size_t i) {
+    scan_slice(starts[i], starts[i + 1], scans[i]);
+  });
+
+  std::vector<size_t> rescan;
+  bool in_string = false;
+  for (size_t i = 0; i < count; i++) {
+    if (in_string)
+      rescan.push_back(i);
+    in_string ^= scans[i].in_string;
+  }
+  parallel_for(workers, rescan.size(), [&](size_t r) {
+    size_t i = rescan[r];
+    bool parity = scans[i].in_string;
+    scan_slice(string_end(starts[i], starts[i + 1]), starts[i + 1], scans[i]);
+    scans[i].in_string = parity;
+  });
+
+  // Depth is one inside the top-level array.
+  std::vector<const char *> cuts;
+  long depth = scans[0].depth;
+  for (size_t i = 1; i < count; i++) {
+    long target = depth - 1;
+    if (target >= 0 && target < (long)array_scan::max_depth &&
+        scans[i].comma[target])
+      cuts.push_back(scans[i].comma[target]);
+    depth += scans[i].depth;
+  }
+
+  // Every piece but the first starts past a comma and implies the '[', every
+  // one but the last ends before one and implies the ']'.
+  const char *begin = data;
+  for (size_t i = 0; i <= cuts.size(); i++) {
+    const char *stop = i < cuts.size() ? cuts[i] : end;
+    pieces.emplace_back(begin, (size_t)(stop - begin), i > 0, i < cuts.size());
+    begin = stop + 1;
+  }
+}
+
+bool jsonparser::json_array_reader::parse() {
+  std::atomic<size_t> failed(pieces.size());
+  parallel_for(workers, pieces.size(), [&](size_t i) {
+    if (i > failed)
+      return;
+    segment &s = pieces[i];
+    s.parser = std::make_unique<json_parser>(s.begin, s.size,
+                                             json_buffer_mode::borrow,
+                                             arena_block);
+    s.parser->fragment(s.open, s.close);
+    s.parser->utf8() = _utf8;
+    if (!s.parser->parse()) {
+      s.error = (s.begin - input.data()) +
+                std::min<long long>(s.parser->position(), s.size);
+    } else if (pieces.size() > 1 &&
+               ((json_array *)&*s.parser->entry())->array.empty()) {
+      // "[]" alone is fine, but no piece may be empty between two commas
+      // or next to a bracket: the comma it borders is out of place.
+      s.error = (s.open ? s.begin - 1 : s.begin + s.size) - input.data();
+    }
+    if (s.error >= 0) {
+      size_t seen = failed;
+      while (i < seen && !failed.compare_exchange_weak(seen, i))
+        ;
+    }
+  });
+
+  if (failed < pieces.size()) {
+    _error_position = pieces[failed].error;
+    _entry = nullptr;
+    return false;
+  }
+
+  // Join the pieces' elements onto the first piece's array.
+  _entry = pieces[0].parser->entry();
+  if (pieces.size() > 1) {
+    auto &array = ((json_array *)&*_entry)->array;
+    size_t total = 0;
+    for (auto &s : pieces)
+      total += ((json_array *)&*s.parser->entry())->array.size();
+    array.reserve(total);
+    for (size_t i = 1; i < pieces.size(); i++) {
+      auto &more = ((json_array *)&*pieces[i].parser->entry())->array;
+      array.insert(array.end(), more.begin(), more.end());
+    }
+  }
+  return true;
+}
@@ -0,0 +1,165 @@
+#ifndef JSONLINES_H
+#define JSONLINES_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "jsonparser.h"
+
+namespace jsonparser {
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Input
+///
+///===-----------------------------------------------------------------------===
+
+// The whole input of a parallel reader, in memory: a private mapping of the
+// file where possible, else a copy of its contents or of the caller's buffer.
+// A gzip or zstd file is decompressed into the copy.
+class json_input {
+  const char *_data = nullptr;
+  size_t _size = 0;
+  bool mapped = false;
+  std::string owned;
+
+public:
+  // Throws std::runtime_error if the file can't be opened.
+  json_input(const std::string &file_path);
+  json_input(const char *data, size_t size, json_buffer_mode mode);
+  ~json_input();
+
+  json_input(const json_input &) = delete;
+  json_input &operator=(const json_input &) = delete;
+
+  const char *data() const { return _data; }
+  size_t size() const { return _size; }
+};
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Lines
+///
+///===-----------------------------------------------------------------------===
+
+// Reader for newline-delimited JSON (JSON Lines, NDJSON): one document per
+// line, blank lines allowed. The input is cut at newlines into chunks of
+// about chunk_size bytes, which a pool of threads parses concurrently. Every
+// chunk gets its own json_parser, so workers never share allocator pools.
+//
+// Documents are owned by the reader and stay valid as long as it lives.
+class json_lines_reader {
+public:
+  static constexpr size_t chunk_size = 1024 * 1024;
+
+  // threads = 0 uses every core.
+  json_lines_reader(std::string file_path, unsigned threads = 0);
+  json_lines_reader(const char *data, size_t size, json_buffer_mode mode,
+                    unsigned threads = 0);
+  ~json_lines_reader();
+
+  json_lines_reader(const json_lines_reader &) = delete;
+  json_lines_reader &operator=(const json_lines_reader &) = delete;
+
+  // Apply paths to every document, see json_parser::filter().
+  void filter(json_path_filter paths);
+  // See json_parser::utf8(). Set before parsing.
+  json_utf8_mode &utf8() { return _utf8; }
+
+  // Parse all lines; documents() holds them in input order. Returns false on
+  // error, see error_line().
+  bool parse();
+
+  // Same, but hand every document to sink as soon as it is parsed instead of
+  // keeping it. sink runs on the worker threads, chunks in any order, and the
+  // document is only valid during the call. line is 1-based.
+  bool parse(const std::function<void(size_t line, jvalue doc)> &sink);
+
+  // With parse(): every document, in order, up to the first error.
+  const std::vector<jvalue> &documents() const { return docs; }
+
+  // 1-based line of the first malformed document, 0 if there is none.
+  size_t error_line() const { return _error_line; }
+
+  unsigned threads() const { return workers; }
+
+private:
+  struct chunk;
+
+  json_input input;
+
+  unsigned workers;
+  json_path_filter paths;
+  json_utf8_mode _utf8 = json_utf8_mode::reject;
+  std::vector<chunk> chunks;
+  std::vector<jvalue> docs;
+  size_t _error_line = 0;
+
+  void split();
+  bool run(const std::function<void(size_t line, jvalue doc)> *sink);
+  void parse_chunk(chunk &c,
+                   const std::function<void(size_t line, jvalue doc)> *sink);
+};
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Array Reader
+///
+///===-----------------------------------------------------------------------===
+
+// Reader for a document that is one big array, parsed by a pool of threads.
+// The input is cut into segments between top-level elements: a quote-aware
+// scan of the structural index finds the commas at depth one, each thread
+// parses a run of elements as an array of its own, and the runs are joined
+// in order. The result is the same array a single json_parser would build.
+//
+// Keys are interned per segment, so json_key handles from one element don't
+// match objects of another; find() by string works everywhere. Any other
+// document is parsed on one thread.
+class json_array_reader {
+public:
+  static constexpr size_t chunk_size = 1024 * 1024;
+
+  // threads = 0 uses every core.
+  json_array_reader(std::string file_path, unsigned threads = 0);
+  json_array_reader(const char *data, size_t size, json_buffer_mode mode,
+                    unsigned threads = 0);
+  ~json_array_reader();
+
+  json_array_reader(const json_array_reader &) = delete;
+  json_array_reader &operator=(const json_array_reader &) = delete;
+
+  // See json_parser::utf8(). Set before parsing.
+  json_utf8_mode &utf8() { return _utf8; }
+
+  // Returns false on error, see error_position().
+  bool parse();
+
+  // The document, owned by the reader.
+  jvalue entry() { return _entry; }
+
+  // Offset of the first malformed token, -1 if there is none.
+  long long error_position() const { return _error_position; }
+
+  // Number of pieces the input was parsed in.
+  size_t segments() const;
+  unsigned threads() const { return workers; }
+
+private:
+  struct segment;
+
+  json_input input;
+  unsigned workers;
+  json_utf8_mode _utf8 = json_utf8_mode::reject;
+  std::vector<segment> pieces;
+  jvalue _entry = nullptr;
+  long long _error_position = -1;
+
+  void split();
+};
+
+} // namespace jsonparser
+
+#endif
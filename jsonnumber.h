@@ -0,0 +1,57 @@
+#ifndef JSONNUMBER_H
+#define JSONNUMBER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+namespace jsonparser {
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Number
+///
+///===-----------------------------------------------------------------------===
+
+typedef enum class _json_number_type : char {
+  int64,       // integer in [-2^63, 2^63)
+  uint64,      // integer in [2^63, 2^64)
+  real,        // has a fraction or an exponent, or is -0
+  big_integer, // integer beyond 64 bits, d holds the nearest double
+} json_number_type;
+
+// A number token decoded once, by the lexer.
+struct json_number {
+  json_number_type type = json_number_type::int64;
+  union {
+    int64_t i;
+    uint64_t u;
+    double d;
+  };
+
+  json_number() : i(0) {}
+
+  bool is_integer() const { return type != json_number_type::real; }
+  double as_double() const;
+
+  // False if printing the value would not give back the number: integers
+  // beyond 64 bits, and reals that overflow to infinity.
+  bool exact() const;
+};
+
+// Check [first, last) against the JSON number grammar and decode it. Reals are
+// correctly rounded: an Eisel-Lemire fast path, std::from_chars when that
+// cannot decide. Returns false if the text isn't a number.
+bool json_decode_number(const char *first, const char *last, json_number &out);
+
+// Shortest text that reads back as the same value, reals keep a '.' or an
+// exponent. Infinities and NaN have no JSON text and come out as null. out
+// must hold json_number_chars bytes; returns the end.
+constexpr size_t json_number_chars = 32;
+char *json_format_number(const json_number &num, char *out);
+
+std::ostream &operator<<(std::ostream &os, const json_number &num);
+
+} // namespace jsonparser
+
+#endif
@@ -1,611 +1,1528 @@
-#include "jsonparser.h"
-#include <memory.h>
-#include <set>
-#include <sstream>
-
-
-///===-----------------------------------------------------------------------===
-///
-///               Json Lexer
-///
-///===-----------------------------------------------------------------------===
-
-jsonparser::json_lexer::json_lexer(std::string file_path, long long buffer_size)
-    : ifs(file_path), curtok(json_token::none), buffer_size(buffer_size) {
-  ifs.seekg(0, std::ios::end);
-  file_size = ifs.tellg();
-  ifs.seekg(0, std::ios::beg);
-
-  buffer = new char[buffer_size];
-  memset(buffer, 0, buffer_size);
-
-  if (!ifs)
-    throw std::runtime_error("file not found!");
-}
-
-jsonparser::json_lexer::~json_lexer() {
-  delete[] buffer;
-  ifs.close();
-}
-
-bool jsonparser::json_lexer::next() {
-  this->curstr = std::string();
-  while (true) {
-    auto cur = next_ch();
-    if (cur == 0) {
-      curtok = json_token::eof;
-      return true;
-    }
-
-    switch (cur) {
-    case ' ':
-    case '\r':
-    case '\n':
-    case '\t':
-      continue;
-
-    case ',':
-      this->curtok = json_token::v_comma;
-      this->curstr = std::string(cur, 1);
-      break;
-
-    case ':':
-      this->curtok = json_token::v_pair;
-      this->curstr = std::string(cur, 1);
-      break;
-
-    case '{':
-      this->curtok = json_token::object_starts;
-      this->curstr = std::string(cur, 1);
-      break;
-
-    case '}':
-      this->curtok = json_token::object_ends;
-      this->curstr = std::string(cur, 1);
-      break;
-
-    case '[':
-      this->curtok = json_token::array_starts;
-      this->curstr = std::string(cur, 1);
-      break;
-
-    case ']':
-      this->curtok = json_token::array_ends;
-      this->curstr = std::string(cur, 1);
-      break;
-
-    case 't':
-    case 'f':
-    case 'n': {
-      std::stringstream ss;
-      while (cur && isalpha(cur)) {
-        ss << cur;
-        cur = next_ch();
-      }
-      prev();
-
-      auto s = ss.str();
-      if (s == "true")
-        this->curtok = json_token::v_true;
-      else if (s == "false")
-        this->curtok = json_token::v_false;
-      else if (s == "nul")
-        this->curtok = json_token::v_null;
-      else
-        return false;
-
-      this->curstr = s;
-    } break;
-
-    case '"': {
-      std::stringstream ss;
-
-      while (cur = next_ch()) {
-        if (cur == '"')
-          break;
-        if (cur < 0) {
-          unsigned char cc = cur;
-          int len = 0;
-          if ((cc & 0xfc) == 0xfc) {
-            len = 6;
-          } else if ((cc & 0xf8) == 0xf8) {
-            len = 5;
-          } else if ((cc & 0xf0) == 0xf0) {
-            len = 4;
-          } else if ((cc & 0xe0) == 0xe0) {
-            len = 3;
-          } else if ((cc & 0xc0) == 0xc0) {
-            len = 2;
-          }
-          for (; --len; cur = next_ch())
-            ss << cur;
-          ss << cur;
-          continue;
-        }
-        ss << cur;
-        if (cur == '\\') {
-          if (!(cur = next_ch()))
-            return false;
-          ss << cur;
-        }
-      }
-
-      curtok = json_token::v_string;
-      curstr = ss.str();
-    }
-
-    break;
-
-    default: {
-      std::stringstream ss;
-
-      if (cur == '-') {
-        ss << cur;
-        cur = next_ch();
-      }
-
-      // [0-9]+
-      while (cur && isdigit(cur)) {
-        ss << cur;
-        cur = next_ch();
-      }
-
-      // [0-9]+.[0-9]+
-      if (cur && cur == '.') {
-        cur = next_ch();
-        if (!cur || !isdigit(cur))
-          return false;
-
-        while (cur && isdigit(cur)) {
-          ss << cur;
-          cur = next_ch();
-        }
-      }
-
-      // [0-9]+[Ee][+-]?[0-9]+
-      // [0-9]+.[0-9]+[Ee][+-]?[0-9]+
-      if (cur && (cur == 'E' || cur == 'e')) {
-        cur = next_ch();
-
-        if (!cur || !(cur == '+' || cur == '-' || isdigit(cur)))
-          return false;
-
-        if (cur == '+' || cur == '-') {
-          ss << cur;
-          cur = next_ch();
-        }
-
-        if (!cur || !isdigit(cur))
-          return false;
-
-        while (cur && isdigit(cur)) {
-          ss << cur;
-          cur = next_ch();
-        }
-      }
-      prev();
-
-      curtok = json_token::v_number;
-      curstr = ss.str();
-    }
-    }
-
-    return true;
-  }
-}
-
-jsonparser::json_token jsonparser::json_lexer::type() const {
-  return this->curtok;
-}
-
-std::string jsonparser::json_lexer::str() { return this->curstr; }
-
-const char *jsonparser::json_lexer::gbuffer() const { return pointer; }
-
-inline void jsonparser::json_lexer::buffer_refresh() {
-  current_block_size = ifs.read(buffer, buffer_size).gcount();
-  read_size += current_block_size;
-  pointer = buffer;
-}
-
-inline bool jsonparser::json_lexer::require_refresh() {
-  return pointer == nullptr || buffer + current_block_size == pointer;
-}
-
-char jsonparser::json_lexer::next_ch() {
-  if (require_refresh()) {
-    if (ifs.eof())
-      return (char)0;
-    buffer_refresh();
-  }
-  return *pointer++;
-}
-
-void jsonparser::json_lexer::prev() { pointer--; }
-
-///===-----------------------------------------------------------------------===
-///
-///               Json Model
-///
-///===-----------------------------------------------------------------------===
-
-std::ostream &jsonparser::json_object::print(std::ostream &os, bool format,
-                                             std::string indent) const {
-  if (!format)
-    os << '{';
-  else
-    os << "{\n";
-  for (auto it = keyvalue.rbegin(); it != keyvalue.rend(); ++it) {
-    if (!format) {
-      os << '\"' << it->first << "\":";
-      it->second->print(os);
-    } else {
-      os << indent << "  \"" << it->first << "\": ";
-      it->second->print(os, true, indent + "  ");
-    }
-    if (std::next(it) != keyvalue.rend()) {
-      if (!format)
-        os << ',';
-      else
-        os << ",\n";
-    }
-  }
-  if (!format)
-    os << '}';
-  else
-    os << '\n' << indent << "}";
-  return os;
-}
-
-std::ostream &jsonparser::json_array::print(std::ostream &os, bool format,
-                                            std::string indent) const {
-  if (array.size() > 0) {
-    if (!format)
-      os << '[';
-    else
-      os << "[\n";
-    for (auto it = array.rbegin(); it != array.rend(); ++it) {
-      if (!format)
-        (*it)->print(os);
-      else {
-        os << indent << "  ";
-        (*it)->print(os, true, indent + "  ");
-      }
-      if (std::next(it) != array.rend()) {
-        if (!format)
-          os << ',';
-        else
-          os << ",\n";
-      }
-    }
-    if (!format)
-      os << ']';
-    else
-      os << '\n' << indent << "]";
-  } else {
-    os << "[]";
-  }
-  return os;
-}
-
-std::ostream &jsonparser::json_numeric::print(std::ostream &os, bool format,
-                                              std::string indent) const {
-  os << numstr;
-  return os;
-}
-
-std::ostream &jsonparser::json_string::print(std::ostream &os, bool format,
-                                             std::string indent) const {
-  os << '"' << str << '"';
-  return os;
-}
-
-std::ostream &jsonparser::json_state::print(std::ostream &os, bool format,
-                                            std::string indent) const {
-  switch (type) {
-  case json_token::v_false:
-    os << "false";
-    break;
-
-  case json_token::v_true:
-    os << "true";
-    break;
-
-  case json_token::v_null:
-    os << "null";
-    break;
-  }
-  return os;
-}
-
-///===-----------------------------------------------------------------------===
-///
-///               Json Parser
-///
-///===-----------------------------------------------------------------------===
-
-static int goto_table[][20] = {
-    {0, 1, 3, 2, 0, 0, 0, 0, 4, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 28},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -1},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -2},
-    {0, 0, 0, 0, 7, 8, 0, 0, 0, 6, 0, 0, 0, 0, 0, 0, 0, 9, 0, 0},
-    {0, 0, 16, 15, 0, 0, 11, 12, 4, 0, 0, 0, 5, 10, 17, 18, 19, 13, 14, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, -5, -5, 0, 0, -5, 0, 0, 0, 0, 0, -5},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 20, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, -7, 21, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 22, 0, 0, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, -3, -3, 0, 0, -3, 0, 0, 0, 0, 0, -3},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 23, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 24, 0, 0, -10, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, -12, -12, 0, 0, -12, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, -13, -13, 0, 0, -13, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, -14, -14, 0, 0, -14, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, -15, -15, 0, 0, -15, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, -16, -16, 0, 0, -16, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, -17, -17, 0, 0, -17, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, -18, -18, 0, 0, -18, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, -6, -6, 0, 0, -6, 0, 0, 0, 0, 0, -6},
-    {0, 0, 0, 0, 25, 8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 9, 0, 0},
-    {0, 0, 16, 15, 0, 0, 0, 26, 4, 0, 0, 0, 5, 0, 17, 18, 19, 13, 14, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, -4, -4, 0, 0, -4, 0, 0, 0, 0, 0, -4},
-    {0, 0, 16, 15, 0, 0, 27, 12, 4, 0, 0, 0, 5, 0, 17, 18, 19, 13, 14, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, -8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, -9, -9, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -11, 0, 0, 0, 0, 0, 0},
-};
-
-static int production[] = {1, 1, 1, 2, 3, 2, 3, 1, 3, 3,
-                           1, 3, 1, 1, 1, 1, 1, 1, 1};
-
-static int group_table[] = {0, 1, 1, 2, 2, 3, 3, 4, 4, 5,
-                            6, 6, 7, 7, 7, 7, 7, 7, 7};
-
-#define ACCEPT_INDEX 28
-
-jsonparser::json_parser::json_parser(std::string file_path,
-                                     size_t pool_capacity)
-    : lex(file_path)
-#ifdef CONFIG_ALLOCATOR
-      ,
-      jarray_pool(pool_capacity), jobject_pool(pool_capacity),
-      jstring_pool(pool_capacity), jnumeric_pool(pool_capacity),
-      jstate_pool(pool_capacity)
-#endif
-{
-}
-
-bool jsonparser::json_parser::step() {
-  if (!_reduce && !lex.next())
-    return false;
-
-  _reduce = false;
-
-  if (stack.empty())
-    stack.push(0);
-
-  bool require_reduce = false;
-  int code = goto_table[stack.top()][(int)lex.type()];
-
-  if (code == ACCEPT_INDEX) {
-    // End of json format
-    _entry = values.top();
-    values.pop();
-    return false;
-  } else if (code > 0) {
-    // Shift
-    stack.push(code);
-    contents.push(lex.str());
-  } else if (code < 0) {
-    // Reduce
-    reduce(code);
-    _reduce = true;
-  } else {
-    // Panic mode
-    this->_error = true;
-    return false;
-  }
-
-  return true;
-}
-
-void jsonparser::json_parser::reduce(int code) {
-  int reduce_production = -code;
-
-  // Reduce Stack
-  for (int i = 0; i < production[reduce_production]; i++) {
-    stack.pop();
-  }
-
-  stack.push(goto_table[stack.top()][group_table[reduce_production]]);
-
-  //   0:         S' -> JSON
-  //   1:       JSON -> OBJECT
-  //   2:       JSON -> ARRAY
-  //   3:      ARRAY -> [ ]
-  //   4:      ARRAY -> [ ELEMENTS ]
-  //   5:     OBJECT -> { }
-  //   6:     OBJECT -> { MEMBERS }
-  //   7:    MEMBERS -> PAIR
-  //   8:    MEMBERS -> PAIR , MEMBERS
-  //   9:       PAIR -> v_string : VALUE
-  //  10:   ELEMENTS -> VALUE
-  //  11:   ELEMENTS -> VALUE , ELEMENTS
-  //  12:      VALUE -> v_string
-  //  13:      VALUE -> v_number
-  //  14:      VALUE -> OBJECT
-  //  15:      VALUE -> ARRAY
-  //  16:      VALUE -> true
-  //  17:      VALUE -> false
-  //  18:      VALUE -> null
-
-  switch (reduce_production) {
-    // case 0:
-    // case 1:
-    // case 2:
-
-  case 3:
-    contents.pop();
-    contents.pop();
-#ifndef CONFIG_ALLOCATOR
-    values.push(jarray(new json_array));
-#else
-    values.push(jarray(jarray_pool.allocate()));
-#endif
-    break;
-
-  case 4:
-    contents.pop();
-    contents.pop();
-    break;
-
-  case 5:
-    contents.pop();
-    contents.pop();
-#ifndef CONFIG_ALLOCATOR
-    values.push(jobject(new json_object()));
-#else
-    values.push(jobject(jobject_pool.allocate()));
-#endif
-    break;
-
-  case 6:
-    contents.pop();
-    contents.pop();
-    break;
-
-  case 7: {
-#ifndef CONFIG_ALLOCATOR
-    auto jo = jobject(new json_object());
-#else
-    auto jo = jobject(jobject_pool.allocate());
-#endif
-    if (!(_skip_literal && values.top()->is_string()))
-      jo->keyvalue.push_back({std::move(contents.top()), values.top()});
-#ifndef CONFIG_ALLOCATOR
-    else
-
-      jo->keyvalue.push_back({std::move(contents.top()),
-                              std::shared_ptr<json_string>(
-                                  new json_string(std::move(std::string())))});
-#else
-    else
-      jo->keyvalue.push_back({std::move(contents.top()),
-                              jstring_pool.allocate(std::move(std::string()))});
-#endif
-    values.pop();
-    values.push(jo);
-    contents.pop();
-  } break;
-
-  case 8: {
-    contents.pop();
-    auto jo = values.top();
-    values.pop();
-    if (!(_skip_literal && values.top()->is_string()))
-      ((json_object *)&*jo)
-          ->keyvalue.push_back({std::move(contents.top()), values.top()});
-#ifndef CONFIG_ALLOCATOR
-    else
-      ((json_object *)&*jo)
-          ->keyvalue.push_back({std::move(contents.top()),
-                                std::shared_ptr<json_string>(new json_string(
-                                    std::move(std::string())))});
-#else
-    else
-      ((json_object *)&*jo)
-          ->keyvalue.push_back(
-              {std::move(contents.top()),
-               jstring_pool.allocate(std::move(std::string()))});
-#endif
-    values.pop();
-    values.push(jo);
-    contents.pop();
-  } break;
-
-  case 9:
-    contents.pop();
-    break;
-
-  case 10: {
-#ifndef CONFIG_ALLOCATOR
-    auto ja = jarray(new json_array());
-#else
-    auto ja = jarray(jarray_pool.allocate());
-#endif
-    if (!(_skip_literal && values.top()->is_string()))
-      ja->array.push_back(values.top());
-    values.pop();
-    values.push(ja);
-  } break;
-
-  case 11: {
-    auto ja = values.top();
-    values.pop();
-    if (!(_skip_literal && values.top()->is_string()))
-      ((json_array *)&*ja)->array.push_back(values.top());
-    values.pop();
-    values.push(ja);
-    contents.pop();
-  } break;
-
-  case 12:
-#ifndef CONFIG_ALLOCATOR
-    values.push(std::shared_ptr<json_string>(new json_string(contents.top())));
-#else
-    values.push(jstring_pool.allocate(std::move(contents.top())));
-#endif
-    contents.pop();
-    break;
-
-  case 13:
-#ifndef CONFIG_ALLOCATOR
-  {
-    auto numeric =
-        std::shared_ptr<json_numeric>(new json_numeric(contents.top()));
-#ifdef CONFIG_CHECK_INTEGER
-    if (!contents.top().Contains('.'))
-      numeric->is_integer = true;
-#endif
-    values.push(numeric);
-  }
-#else
-    values.push(jnumeric_pool.allocate(std::move(contents.top())));
-#endif
-    contents.pop();
-    break;
-
-    // case 14:
-    // case 15:
-
-  case 16:
-#ifndef CONFIG_ALLOCATOR
-    values.push(std::shared_ptr<json_state>(
-        new json_state(jsonparser::json_token::v_true)));
-#else
-    values.push(jstate_pool.allocate(jsonparser::json_token::v_true));
-#endif
-    contents.pop();
-    break;
-
-  case 17:
-#ifndef CONFIG_ALLOCATOR
-    values.push(std::shared_ptr<json_state>(
-        new json_state(jsonparser::json_token::v_false)));
-#else
-    values.push(jstate_pool.allocate(jsonparser::json_token::v_false));
-#endif
-    contents.pop();
-    break;
-
-  case 18:
-#ifndef CONFIG_ALLOCATOR
-    values.push(std::shared_ptr<json_state>(
-        new json_state(jsonparser::json_token::v_null)));
-#else
-    values.push(jstate_pool.allocate(jsonparser::json_token::v_null));
-#endif
-    contents.pop();
-    break;
-  }
-}
\ No newline at end of file
+#include "jsonparser.h"
+#include "jsonsax.h"
+#include "jsontape.h"
+#include "jsonwriter.h"
+#include <memory.h>
+#include <set>
+#include <sstream>
+
+#ifdef CONFIG_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef CONFIG_ALLOCATOR
+///===-----------------------------------------------------------------------===
+///
+///               Json Arena
+///
+///===-----------------------------------------------------------------------===
+
+jsonparser::json_arena::~json_arena() {
+  for (auto &b : blocks)
+    ::operator delete(b.data);
+}
+
+// The current block is full: start a new one, twice the size of the last.
+void *jsonparser::json_arena::grow(size_t size, size_t align) {
+  size_t want = std::max(next_block, size + align);
+  char *data = (char *)::operator new(want);
+  blocks.push_back({data, want});
+  _reserved += want;
+  if (next_block < max_block)
+    next_block = std::min(next_block * 2, max_block);
+
+  cur = data;
+  end = data + want;
+  return bump(size, align);
+}
+
+void jsonparser::json_arena::reset() {
+  if (blocks.empty())
+    return;
+  auto largest = std::max_element(
+      blocks.begin(), blocks.end(),
+      [](const block &a, const block &b) { return a.size < b.size; });
+  block keep = *largest;
+  for (auto &b : blocks)
+    if (b.data != keep.data)
+      ::operator delete(b.data);
+  blocks.assign(1, keep);
+
+  cur = keep.data;
+  end = keep.data + keep.size;
+  _reserved = keep.size;
+  _used = 0;
+}
+#endif
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Lexer
+///
+///===-----------------------------------------------------------------------===
+
+jsonparser::json_lexer::json_lexer(std::string file_path, long long buffer_size)
+    : json_lexer(file_path, json_input_mode::buffered, buffer_size) {}
+
+jsonparser::json_lexer::json_lexer(std::string file_path, json_input_mode mode,
+                                   long long buffer_size)
+    : curtok(json_token::none), block_size(buffer_size) {
+  attach(file_path, mode);
+}
+
+jsonparser::json_lexer::json_lexer(std::unique_ptr<json_block_source> source,
+                                   long long buffer_size)
+    : curtok(json_token::none), block_size(buffer_size) {
+  attach(std::move(source));
+}
+
+jsonparser::json_lexer::json_lexer(const char *data, size_t size,
+                                   json_buffer_mode mode)
+    : curtok(json_token::none) {
+  attach(data, size, mode);
+}
+
+jsonparser::json_lexer::json_lexer() : curtok(json_token::none) { attach(); }
+
+jsonparser::json_lexer::~json_lexer() {
+  release();
+  delete[] heap;
+  delete[] spare;
+}
+
+void jsonparser::json_lexer::reset(std::string file_path,
+                                   json_input_mode mode) {
+  release();
+  attach(file_path, mode);
+}
+
+void jsonparser::json_lexer::reset(const char *data, size_t size,
+                                   json_buffer_mode mode) {
+  release();
+  attach(data, size, mode);
+}
+
+void jsonparser::json_lexer::reset(std::unique_ptr<json_block_source> source) {
+  release();
+  attach(std::move(source));
+}
+
+void jsonparser::json_lexer::reset() {
+  release();
+  attach();
+}
+
+void jsonparser::json_lexer::attach(const std::string &file_path,
+                                    json_input_mode mode) {
+  // A compressed file is streamed through its decompressor, never mapped.
+  if (mode == json_input_mode::mapped &&
+      json_file_compression(file_path) == json_compression::none &&
+      map_file(file_path))
+    return;
+  attach(json_open_source(file_path));
+}
+
+void jsonparser::json_lexer::attach(std::unique_ptr<json_block_source> blocks) {
+  source = std::move(blocks);
+  file_size = source->size();
+  source_failed = false;
+
+  window = window_kind::stream;
+  buffer = heap_buffer(headroom + block_size) + headroom;
+  buffer_size = block_size;
+  spare_buffer(headroom + block_size);
+  pointer = buffer;
+  slice = indexed = buffer;
+  read_ahead();
+}
+
+// Start reading the next block into spare.
+void jsonparser::json_lexer::read_ahead() {
+  char *target = spare + headroom;
+  long long size = requested = block_size;
+  ahead = std::async(std::launch::async, [this, target, size] {
+    return source->read(target, size);
+  });
+}
+
+void jsonparser::json_lexer::attach(const char *data, size_t size,
+                                    json_buffer_mode mode) {
+  if (mode == json_buffer_mode::copy) {
+    window = window_kind::copied;
+    buffer = heap_buffer(size);
+    memcpy(buffer, data, size);
+  } else {
+    window = window_kind::borrowed;
+    buffer = (char *)data;
+  }
+
+  file_size = read_size = current_block_size = buffer_size = size;
+  pointer = buffer;
+  slice = indexed = buffer;
+}
+
+void jsonparser::json_lexer::attach() {
+  window = window_kind::pushed;
+  finished = false;
+  // The size is known at finish().
+  file_size = -1;
+  buffer = pointer = heap_buffer(1024 * 4);
+  buffer_size = heap_size;
+  slice = indexed = buffer;
+}
+
+// The lexed part of the window is dropped; the rest moves to the front of the
+// heap block, followed by data. The index starts over at the read position,
+// which is never inside a string.
+void jsonparser::json_lexer::append(const char *data, size_t size) {
+  long long tail = buffer + current_block_size - pointer;
+  if (heap_size < tail + (long long)size) {
+    long long grown = std::max(heap_size * 2, tail + (long long)size);
+    char *larger = new char[grown];
+    memcpy(larger, pointer, tail);
+    delete[] heap;
+    heap = larger;
+    heap_size = grown;
+  } else if (pointer != heap) {
+    memmove(heap, pointer, tail);
+  }
+  memcpy(heap + tail, data, size);
+
+  buffer = pointer = heap;
+  buffer_size = heap_size;
+  read_size += size;
+  current_block_size = tail + size;
+#ifdef CONFIG_STATS
+  if (counters) {
+    counters->refreshes++;
+    counters->bytes_read += size;
+  }
+#endif
+
+  index.reset();
+  slice = indexed = buffer;
+  cursor = 0;
+}
+
+void jsonparser::json_lexer::finish() {
+  finished = true;
+  file_size = read_size;
+}
+
+// Let go of the input. The heap block stays for the next one.
+void jsonparser::json_lexer::release() {
+  switch (window) {
+  case window_kind::stream:
+    // The reader thread may still be filling spare.
+    if (ahead.valid())
+      ahead.get();
+    source.reset();
+    break;
+  case window_kind::mapped:
+#ifdef CONFIG_MMAP
+    if (buffer)
+      munmap(buffer, current_block_size);
+#endif
+    break;
+  case window_kind::copied:
+  case window_kind::borrowed:
+  case window_kind::pushed:
+    break;
+  }
+
+  finished = true;
+  suspended = false;
+  wanted = 0;
+  curtok = json_token::none;
+  curspan = {0, 0, 0};
+  read_size = current_block_size = 0;
+  buffer = pointer = nullptr;
+  index.reset();
+  slice = indexed = nullptr;
+  cursor = 0;
+}
+
+// The heap block, at least size bytes. Its contents are not kept.
+char *jsonparser::json_lexer::heap_buffer(long long size) {
+  if (heap_size < size) {
+    delete[] heap;
+    heap = new char[size];
+    heap_size = size;
+  }
+  return heap;
+}
+
+// Same for spare, the read-ahead buffer.
+char *jsonparser::json_lexer::spare_buffer(long long size) {
+  if (spare_size < size) {
+    delete[] spare;
+    spare = new char[size];
+    spare_size = size;
+  }
+  return spare;
+}
+
+// Map a regular file as a single window. Returns false if the file has to be
+// read through the buffered path instead.
+bool jsonparser::json_lexer::map_file(const std::string &file_path) {
+#ifdef CONFIG_MMAP
+  int fd = open(file_path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("file not found!");
+
+  struct stat st;
+  if (fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return false;
+  }
+
+  buffer = nullptr;
+  if (st.st_size > 0) {
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      close(fd);
+      return false;
+    }
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+    buffer = (char *)addr;
+  }
+  close(fd);
+
+  window = window_kind::mapped;
+  file_size = read_size = current_block_size = buffer_size = st.st_size;
+  pointer = buffer;
+  slice = indexed = buffer;
+  return true;
+#else
+  return false;
+#endif
+}
+
+static inline bool is_scalar_byte(char c) {
+  switch (c) {
+  case ' ':
+  case '\r':
+  case '\n':
+  case '\t':
+  case ',':
+  case ':':
+  case '{':
+  case '}':
+  case '[':
+  case ']':
+  case '"':
+    return false;
+  default:
+    return true;
+  }
+}
+
+bool jsonparser::json_lexer::next() {
+  suspended = false;
+  while (true) {
+    const char *cur = next_structural();
+    if (cur == nullptr) {
+      if (require_refresh()) {
+        buffer_refresh(buffer + current_block_size);
+        continue;
+      }
+      if (starving())
+        return starve(pointer);
+      pointer = buffer + current_block_size;
+      if (source_failed)
+        return false;
+      curtok = json_token::eof;
+      curspan = {(size_t)current_block_size, 0, 0};
+      return true;
+    }
+
+    switch (*cur) {
+    case ',':
+      this->curtok = json_token::v_comma;
+      break;
+
+    case ':':
+      this->curtok = json_token::v_pair;
+      break;
+
+    case '{':
+      this->curtok = json_token::object_starts;
+      break;
+
+    case '}':
+      this->curtok = json_token::object_ends;
+      break;
+
+    case '[':
+      this->curtok = json_token::array_starts;
+      break;
+
+    case ']':
+      this->curtok = json_token::array_ends;
+      break;
+
+    case '"': {
+      // Everything up to the closing quote is masked out of the index, so the
+      // next structural offset is the closing quote.
+      const char *close = next_structural();
+      if (close == nullptr) {
+        if (require_refresh()) {
+          buffer_refresh(cur);
+          continue;
+        }
+        if (starving())
+          return starve(cur);
+        pointer = (char *)cur;
+        return false;
+      }
+
+      // Unescaping and replacement are left to materialize(), only note
+      // that they are needed.
+      size_t len = close - cur - 1;
+      unsigned flags = memchr(cur + 1, '\\', len) ? span_escaped : 0u;
+      if (utf8 != json_utf8_mode::accept) {
+        size_t valid = json_utf8_validate(cur + 1, len);
+        if (valid != len) {
+          if (utf8 == json_utf8_mode::reject) {
+            // Leave position() at the bad byte.
+            pointer = (char *)cur + 1 + valid;
+            return false;
+          }
+          flags |= span_invalid;
+        }
+      }
+      curtok = json_token::v_string;
+      curspan = {(size_t)(cur + 1 - buffer), len, flags};
+      pointer = (char *)close + 1;
+      return true;
+    }
+
+    default: {
+      const char *end = buffer + current_block_size;
+      const char *last = cur;
+      while (last != end && is_scalar_byte(*last))
+        last++;
+
+      // The token may continue in the next block.
+      if (last == end && require_refresh()) {
+        buffer_refresh(cur);
+        continue;
+      }
+      if (last == end && starving())
+        return starve(cur);
+
+      size_t len = last - cur;
+      if (len == 4 && !memcmp(cur, "true", 4))
+        curtok = json_token::v_true;
+      else if (len == 5 && !memcmp(cur, "false", 5))
+        curtok = json_token::v_false;
+      else if (len == 4 && !memcmp(cur, "null", 4))
+        curtok = json_token::v_null;
+      else if (json_decode_number(cur, last, curnum))
+        curtok = json_token::v_number;
+      else {
+        // Leave position() at the bad token.
+        pointer = (char *)cur;
+        return false;
+      }
+
+      curspan = {(size_t)(cur - buffer), len, 0};
+      pointer = (char *)last;
+      return true;
+    }
+    }
+
+    curspan = {(size_t)(cur - buffer), 1, 0};
+    pointer = (char *)cur + 1;
+    return true;
+  }
+}
+
+bool jsonparser::json_lexer::skip_value() {
+  suspended = false;
+  const char *start = buffer + curspan.offset;
+  if (curtok == json_token::object_starts ||
+      curtok == json_token::array_starts) {
+    int depth = 1;
+    while (depth) {
+      const char *cur = next_structural();
+      if (cur == nullptr) {
+        if (starving())
+          return starve(start);
+        if (!require_refresh())
+          return false;
+        // Nothing skipped needs to survive the refill.
+        buffer_refresh(buffer + current_block_size);
+        start = buffer;
+        continue;
+      }
+
+      switch (*cur) {
+      case '{':
+      case '[':
+        depth++;
+        break;
+      case '}':
+      case ']':
+        depth--;
+        break;
+      case '"':
+        // The closing quote is the next offset, unless the string is cut.
+        if (next_structural() == nullptr) {
+          if (starving())
+            return starve(start);
+          if (!require_refresh())
+            return false;
+          buffer_refresh(cur);
+          start = buffer;
+          continue;
+        }
+        break;
+      }
+      pointer = (char *)cur + 1;
+    }
+  }
+
+  curtok = json_token::v_null;
+  curspan = {(size_t)(start - buffer), (size_t)(pointer - start), 0};
+  JSON_STATS(if (counters) counters->skipped++);
+  return true;
+}
+
+std::string jsonparser::json_lexer::str() const {
+  std::string str;
+  materialize(str);
+  return str;
+}
+
+bool jsonparser::json_lexer::materialize(std::string &out) const {
+  const char *data = buffer + curspan.offset;
+  if (!(curspan.flags & span_invalid)) {
+    if (curspan.flags & span_escaped)
+      return json_unescape(data, curspan.length, out);
+    out.assign(data, curspan.length);
+    return true;
+  }
+
+  // Escapes decode to whole sequences, so the invalid ones are the same
+  // after unescaping.
+  out.clear();
+  if (!(curspan.flags & span_escaped)) {
+    json_utf8_replace(data, curspan.length, out);
+    return true;
+  }
+  std::string unescaped;
+  if (!json_unescape(data, curspan.length, unescaped))
+    return false;
+  json_utf8_replace(unescaped.data(), unescaped.size(), out);
+  return true;
+}
+
+static inline int hex_value(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  c |= 0x20;
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+static bool read_hex4(const char *p, const char *end, unsigned &out) {
+  if (end - p < 4)
+    return false;
+  out = 0;
+  for (int i = 0; i < 4; i++) {
+    int v = hex_value(p[i]);
+    if (v < 0)
+      return false;
+    out = out << 4 | v;
+  }
+  return true;
+}
+
+static void append_utf8(std::string &out, unsigned cp) {
+  if (cp < 0x80) {
+    out += (char)cp;
+  } else if (cp < 0x800) {
+    out += (char)(0xc0 | cp >> 6);
+    out += (char)(0x80 | (cp & 0x3f));
+  } else if (cp < 0x10000) {
+    out += (char)(0xe0 | cp >> 12);
+    out += (char)(0x80 | (cp >> 6 & 0x3f));
+    out += (char)(0x80 | (cp & 0x3f));
+  } else {
+    out += (char)(0xf0 | cp >> 18);
+    out += (char)(0x80 | (cp >> 12 & 0x3f));
+    out += (char)(0x80 | (cp >> 6 & 0x3f));
+    out += (char)(0x80 | (cp & 0x3f));
+  }
+}
+
+bool jsonparser::json_unescape(const char *data, size_t size,
+                               std::string &out) {
+  const char *end = data + size;
+  out.clear();
+  out.reserve(size);
+
+  while (data != end) {
+    const char *escape = (const char *)memchr(data, '\\', end - data);
+    if (escape == nullptr) {
+      out.append(data, end);
+      break;
+    }
+    out.append(data, escape);
+    data = escape + 1;
+    if (data == end)
+      return false;
+
+    switch (*data++) {
+    case '"':
+      out += '"';
+      break;
+    case '\\':
+      out += '\\';
+      break;
+    case '/':
+      out += '/';
+      break;
+    case 'b':
+      out += '\b';
+      break;
+    case 'f':
+      out += '\f';
+      break;
+    case 'n':
+      out += '\n';
+      break;
+    case 'r':
+      out += '\r';
+      break;
+    case 't':
+      out += '\t';
+      break;
+    case 'u': {
+      unsigned cp, low;
+      if (!read_hex4(data, end, cp))
+        return false;
+      data += 4;
+      if (cp >= 0xd800 && cp <= 0xdbff) {
+        // A high surrogate must be followed by an escaped low surrogate.
+        if (end - data < 6 || data[0] != '\\' || data[1] != 'u' ||
+            !read_hex4(data + 2, end, low) || low < 0xdc00 || low > 0xdfff)
+          return false;
+        data += 6;
+        cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+      } else if (cp >= 0xdc00 && cp <= 0xdfff) {
+        return false;
+      }
+      append_utf8(out, cp);
+    } break;
+    default:
+      return false;
+    }
+  }
+  return true;
+}
+
+const char *jsonparser::json_lexer::gbuffer() const { return pointer; }
+
+// Move on to the block read ahead, carrying over [keep, end) of the current
+// window so that a token cut by the block boundary is lexed again in one
+// piece. The tail goes in the headroom in front of the new block; one that
+// doesn't fit gets a buffer of its own, joined with the block.
+inline void jsonparser::json_lexer::buffer_refresh(const char *keep) {
+  JSON_STATS(uint64_t start = json_cycles());
+  long long tail = buffer + current_block_size - keep;
+  long long count = ahead.get();
+  if (count < 0) {
+    source_failed = true;
+    count = 0;
+  }
+  char *block = spare + headroom;
+
+  if (tail <= headroom) {
+    memmove(block - tail, keep, tail);
+    std::swap(heap, spare);
+    std::swap(heap_size, spare_size);
+    buffer = block - tail;
+  } else {
+    // A token this long gets longer blocks, so that it is copied a
+    // logarithmic number of times.
+    if (tail > block_size)
+      block_size *= 2;
+    long long size = std::max(tail + count, headroom + block_size);
+    char *joined = new char[size];
+    memcpy(joined, keep, tail);
+    memcpy(joined + tail, block, count);
+    delete[] heap;
+    heap = buffer = joined;
+    heap_size = size;
+    spare_buffer(headroom + block_size);
+  }
+
+  read_size += count;
+  current_block_size = tail + count;
+  pointer = buffer;
+
+  index.reset();
+  slice = indexed = buffer;
+  cursor = 0;
+
+  // The source is only touched by the reader thread until the next get(). A
+  // short block was the last.
+  if (count == requested)
+    read_ahead();
+
+#ifdef CONFIG_STATS
+  if (counters) {
+    counters->refreshes++;
+    counters->bytes_read += count;
+    counters->io_cycles += json_cycles() - start;
+  }
+#endif
+}
+
+inline bool jsonparser::json_lexer::require_refresh() {
+  return window == window_kind::stream && ahead.valid();
+}
+
+// Pushed input ran out before the token at keep, or the value skipped from
+// there, is complete. Go back to keep and fail; the next try starts there
+// with a fresh index once the input has doubled past it.
+bool jsonparser::json_lexer::starve(const char *keep) {
+  pointer = (char *)keep;
+  curtok = json_token::none;
+  curspan = {(size_t)(keep - buffer), 0, 0};
+  wanted = 2 * (buffer + current_block_size - keep) + 1;
+
+  index.reset();
+  slice = indexed = keep;
+  cursor = 0;
+  suspended = true;
+  return false;
+}
+
+const char *jsonparser::json_lexer::next_structural() {
+  while (cursor == index.count()) {
+    const char *end = buffer + current_block_size;
+    if (indexed == end)
+      return nullptr;
+
+    size_t size = std::min<size_t>(end - indexed,
+                                   json_structural_index::slice_size);
+    slice = indexed;
+    index.build(slice, size);
+    indexed += size;
+    cursor = 0;
+  }
+  return slice + index.offsets()[cursor++];
+}
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Keys
+///
+///===-----------------------------------------------------------------------===
+
+jsonparser::json_key jsonparser::json_key_table::intern(std::string_view str) {
+  size_t h = hash(str);
+  size_t mask = slots.size() - 1;
+  size_t slot = h & mask;
+  for (; slots[slot]; slot = (slot + 1) & mask)
+    if (slots[slot]->hash == h && slots[slot]->str == str)
+      return json_key(slots[slot]);
+
+  entries.push_back({std::string(str), h});
+  slots[slot] = &entries.back();
+  json_key key(slots[slot]);
+
+  // Keep the load factor under one half.
+  if (entries.size() * 2 > slots.size())
+    grow();
+  return key;
+}
+
+jsonparser::json_key
+jsonparser::json_key_table::find(std::string_view str) const {
+  size_t h = hash(str);
+  size_t mask = slots.size() - 1;
+  for (size_t slot = h & mask; slots[slot]; slot = (slot + 1) & mask)
+    if (slots[slot]->hash == h && slots[slot]->str == str)
+      return json_key(slots[slot]);
+  return json_key();
+}
+
+void jsonparser::json_key_table::grow() {
+  std::vector<json_key_entry *> grown(slots.size() * 2);
+  size_t mask = grown.size() - 1;
+  for (auto &entry : entries) {
+    size_t slot = entry.hash & mask;
+    while (grown[slot])
+      slot = (slot + 1) & mask;
+    grown[slot] = &entry;
+  }
+  slots.swap(grown);
+}
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Model
+///
+///===-----------------------------------------------------------------------===
+
+void jsonparser::json_object::build_index() const {
+  size_t slots = 1;
+  while (slots < keyvalue.size() * 2)
+    slots <<= 1;
+  if (!index || index->mask + 1 != slots) {
+    release_index();
+    void *p = keyvalue.get_allocator().resource()->allocate(
+        sizeof(hash_index) + slots * sizeof(unsigned), alignof(hash_index));
+    index = new (p) hash_index{0, slots - 1};
+  }
+
+  unsigned *table = index->slots();
+  std::fill(table, table + slots, 0u);
+  for (size_t i = 0; i < keyvalue.size(); i++) {
+    size_t slot = keyvalue[i].first.hash() & index->mask;
+    while (table[slot] && keyvalue[table[slot] - 1].first != keyvalue[i].first)
+      slot = (slot + 1) & index->mask;
+    // Keep the first of duplicate keys, as the linear scan does.
+    if (!table[slot])
+      table[slot] = i + 1;
+  }
+  index->indexed = keyvalue.size();
+}
+
+void jsonparser::json_object::release_index() const {
+  if (index)
+    keyvalue.get_allocator().resource()->deallocate(
+        index, sizeof(hash_index) + (index->mask + 1) * sizeof(unsigned),
+        alignof(hash_index));
+  index = nullptr;
+}
+
+jsonparser::jvalue jsonparser::json_object::find(std::string_view key) const {
+  if (keyvalue.size() <= linear_limit) {
+    for (auto &kv : keyvalue)
+      if (kv.first.size() == key.size() &&
+          !memcmp(kv.first.str().data(), key.data(), key.size()))
+        return kv.second;
+    return nullptr;
+  }
+
+  if (!index || index->indexed != keyvalue.size())
+    build_index();
+
+  size_t hash = json_key_table::hash(key);
+  const unsigned *table = index->slots();
+  for (size_t slot = hash & index->mask; table[slot];
+       slot = (slot + 1) & index->mask) {
+    auto &kv = keyvalue[table[slot] - 1];
+    if (kv.first.hash() == hash && kv.first == key)
+      return kv.second;
+  }
+  return nullptr;
+}
+
+jsonparser::jvalue jsonparser::json_object::find(json_key key) const {
+  if (!key.valid())
+    return nullptr;
+
+  if (keyvalue.size() <= linear_limit) {
+    for (auto &kv : keyvalue)
+      if (kv.first == key)
+        return kv.second;
+    return nullptr;
+  }
+
+  if (!index || index->indexed != keyvalue.size())
+    build_index();
+
+  const unsigned *table = index->slots();
+  for (size_t slot = key.hash() & index->mask; table[slot];
+       slot = (slot + 1) & index->mask)
+    if (keyvalue[table[slot] - 1].first == key)
+      return keyvalue[table[slot] - 1].second;
+  return nullptr;
+}
+
+// Output is json_writer's, which walks nested values itself.
+std::ostream &jsonparser::json_object::print(std::ostream &os, bool format,
+                                             std::string indent) const {
+  json_writer(os, format).write(*this, indent.size() / 2);
+  return os;
+}
+
+std::ostream &jsonparser::json_array::print(std::ostream &os, bool format,
+                                            std::string indent) const {
+  json_writer(os, format).write(*this, indent.size() / 2);
+  return os;
+}
+
+// Scalars have nothing to indent.
+std::ostream &jsonparser::json_numeric::print(std::ostream &os, bool format,
+                                              std::string /* indent */) const {
+  json_writer(os, format).write(*this);
+  return os;
+}
+
+std::ostream &jsonparser::json_string::print(std::ostream &os, bool format,
+                                             std::string /* indent */) const {
+  json_writer(os, format).write(*this);
+  return os;
+}
+
+std::ostream &jsonparser::json_state::print(std::ostream &os, bool format,
+                                            std::string /* indent */) const {
+  json_writer(os, format).write(*this);
+  return os;
+}
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Parser
+///
+///===-----------------------------------------------------------------------===
+
+jsonparser::json_parser::json_parser(std::string file_path,
+                                     size_t arena_block,
+                                     json_input_mode mode)
+    : lex(file_path, mode)
+#ifdef CONFIG_ALLOCATOR
+      ,
+      _arena(arena_block), resource(&_arena)
+#else
+      ,
+      resource(std::pmr::new_delete_resource())
+#endif
+{
+  reserve_stacks();
+}
+
+jsonparser::json_parser::json_parser(const char *data, size_t size,
+                                     json_buffer_mode mode,
+                                     size_t arena_block)
+    : lex(data, size, mode)
+#ifdef CONFIG_ALLOCATOR
+      ,
+      _arena(arena_block), resource(&_arena)
+#else
+      ,
+      resource(std::pmr::new_delete_resource())
+#endif
+{
+  reserve_stacks();
+}
+
+jsonparser::json_parser::json_parser(size_t arena_block)
+#ifdef CONFIG_ALLOCATOR
+    : _arena(arena_block), resource(&_arena)
+#else
+    : resource(std::pmr::new_delete_resource())
+#endif
+{
+  reserve_stacks();
+}
+
+jsonparser::json_parser::json_parser(
+    std::unique_ptr<json_block_source> source, size_t arena_block)
+    : lex(std::move(source))
+#ifdef CONFIG_ALLOCATOR
+      ,
+      _arena(arena_block), resource(&_arena)
+#else
+      ,
+      resource(std::pmr::new_delete_resource())
+#endif
+{
+  reserve_stacks();
+}
+
+void jsonparser::json_parser::reserve_stacks() {
+  JSON_STATS(lex.count(&_stats));
+  key_table = std::make_shared<json_key_table>();
+  contents.reserve(64);
+  numbers.reserve(64);
+  key_stack.reserve(64);
+  stack.reserve(256);
+  values.reserve(256);
+}
+
+void jsonparser::json_parser::reset(std::string file_path,
+                                    json_input_mode mode,
+                                    json_reset_mode values) {
+  restart(values);
+  lex.reset(file_path, mode);
+}
+
+void jsonparser::json_parser::reset(const char *data, size_t size,
+                                    json_buffer_mode mode,
+                                    json_reset_mode values) {
+  restart(values);
+  lex.reset(data, size, mode);
+}
+
+void jsonparser::json_parser::reset(std::unique_ptr<json_block_source> source,
+                                    json_reset_mode values) {
+  restart(values);
+  lex.reset(std::move(source));
+}
+
+void jsonparser::json_parser::reset(json_reset_mode values) {
+  restart(values);
+  lex.reset();
+}
+
+// The automaton state stays in the stacks between pieces: parse() returns
+// when the lexer starves and resumes with the lookahead it couldn't read.
+bool jsonparser::json_parser::feed(const char *data, size_t size) {
+  if (_error)
+    return false;
+  lex.append(data, size);
+  if (!lex.ready() || parse())
+    return true;
+  return !_error;
+}
+
+bool jsonparser::json_parser::finish() {
+  if (_error)
+    return false;
+  lex.finish();
+  return parse();
+}
+
+void jsonparser::json_parser::restart(json_reset_mode mode) {
+  _entry = nullptr;
+  _error = _reduce = _following = false;
+  _implied_open = _implied_close = false;
+  _skipped = false;
+  JSON_STATS(_stats = json_stats());
+
+  contents.clear();
+  numbers.clear();
+  key_stack.clear();
+  stack.clear();
+  values.clear();
+  if (filtering)
+    filter_restart();
+
+  if (mode == json_reset_mode::release) {
+#ifdef CONFIG_ALLOCATOR
+    _arena.reset();
+#endif
+    if (key_table->size() > max_kept_keys)
+      key_table = std::make_shared<json_key_table>();
+  }
+}
+
+bool jsonparser::json_parser::step() {
+  JSON_STATS(_mark = json_cycles());
+  if (!_reduce && !next()) {
+    this->_error = true;
+    return false;
+  }
+
+  _reduce = false;
+
+  if (stack.empty())
+    stack.push_back(0);
+
+  int code = detail::action_table.row[stack.back()][(int)lex.type()];
+
+  if (code == detail::accept_index) {
+    // End of json format
+    _entry = values.back();
+    values.pop_back();
+    return false;
+  } else if (code > 0) {
+    // Shift
+    if (!shift(code)) {
+      this->_error = true;
+      return false;
+    }
+  } else if (code < 0) {
+    // Reduce
+    reduce(code);
+    _reduce = true;
+  } else {
+    // Panic mode
+    this->_error = true;
+    return false;
+  }
+
+  return true;
+}
+
+bool jsonparser::json_parser::parse() {
+  JSON_STATS(_mark = json_cycles());
+  if (stack.empty())
+    stack.push_back(0);
+
+  // Resume after a reduce left pending by step(), or after the previous
+  // document of a sequence: the lookahead is current.
+  if (_implied_open) {
+    _implied_open = false;
+    lex.imply(json_token::array_starts);
+  } else if (!_reduce && !_following && !next()) {
+    this->_error = !lex.starved();
+    return false;
+  }
+  _reduce = false;
+  _following = false;
+
+  while (true) {
+    int code = detail::action_table.row[stack.back()][(int)lex.type()];
+
+    // In a sequence, the first token of the next document ends this one the
+    // way eof would.
+    if (code == 0 && _sequence)
+      code = detail::action_table.row[stack.back()][(int)json_token::eof];
+
+    // A fragment's input runs out where its closing bracket is implied.
+    if (code == 0 && _implied_close && lex.type() == json_token::eof) {
+      _implied_close = false;
+      lex.imply(json_token::array_ends);
+      continue;
+    }
+
+    if (code < 0) {
+      reduce(code);
+      continue;
+    }
+
+    if (code == detail::accept_index) {
+      _entry = values.back();
+      values.pop_back();
+      if (_sequence) {
+        stack.clear();
+        _following = true;
+        if (filtering)
+          filter_restart();
+      }
+      return true;
+    }
+
+    if (code == 0 || !shift(code)) {
+      this->_error = true;
+      return false;
+    }
+    if (!next()) {
+      this->_error = !lex.starved();
+      return false;
+    }
+  }
+}
+
+bool jsonparser::json_parser::parse(json_tape &tape) {
+  json_tape_builder builder(tape);
+  // The builder only stops on a document the tape can't hold.
+  if (parse_events(builder))
+    return true;
+  _error = true;
+  return false;
+}
+
+inline bool jsonparser::json_parser::shift(int code) {
+  JSON_STATS(_stats.shifts++);
+  stack.push_back(code);
+  if (code == detail::key_state) {
+    if (!shift_key())
+      return false;
+  } else if (lex.type() == json_token::v_string) {
+    // Only strings and numbers carry a value into the reductions. Their text
+    // goes to node memory right away, the node takes it over as it is.
+    if (lex.span().flags & (span_escaped | span_invalid)) {
+      if (!lex.materialize(scratch))
+        return false;
+      contents.emplace_back(std::string_view(scratch), resource);
+    } else {
+      contents.emplace_back(lex.view(), resource);
+    }
+  } else if (lex.type() == json_token::v_number) {
+    // Numbers come decoded; the text is kept only if asked for or needed.
+    numbers.push_back(lex.number());
+    contents.emplace_back(resource);
+    if (_keep_number_text || !lex.number().exact())
+      contents.back().assign(lex.view());
+  }
+
+  if (filtering)
+    filter_shift(code);
+  JSON_STATS(charge(_stats.shift_cycles));
+  return true;
+}
+
+// Advance the lookahead; with a filter, skip it if it starts an unselected
+// value.
+inline bool jsonparser::json_parser::next() {
+  bool ok = lex.next() && (!filter_pending || filter_value());
+  JSON_STATS(_stats.tokens += ok; charge(_stats.lex_cycles));
+  return ok;
+}
+
+void jsonparser::json_parser::filter(json_path_filter filter_paths) {
+  paths = std::move(filter_paths);
+  filtering = !paths.empty();
+  filter_restart();
+}
+
+// Back at the root of a document.
+void jsonparser::json_parser::filter_restart() {
+  child_whole = paths.selects_root();
+  child_alive = child_whole ? 0 : paths.all();
+  filter_pending = false;
+  filter_frames.clear();
+}
+
+void jsonparser::json_parser::filter_child(std::string_view key,
+                                           size_t index) {
+  const filter_frame &f = filter_frames.back();
+  if (f.whole) {
+    child_whole = true;
+    child_alive = 0;
+  } else if (f.object) {
+    child_alive =
+        paths.match_key(f.alive, filter_frames.size() - 1, key, child_whole);
+  } else {
+    child_alive = paths.match_index(f.alive, filter_frames.size() - 1, index,
+                                    child_whole);
+  }
+}
+
+void jsonparser::json_parser::filter_shift(int code) {
+  switch (lex.type()) {
+  case json_token::object_starts:
+    filter_frames.push_back({child_alive, 0, child_whole, true});
+    break;
+
+  case json_token::array_starts:
+    filter_frames.push_back({child_alive, 0, child_whole, false});
+    filter_child({}, 0);
+    filter_pending = true;
+    break;
+
+  case json_token::object_ends:
+  case json_token::array_ends:
+    filter_frames.pop_back();
+    break;
+
+  case json_token::v_string:
+    if (code == detail::key_state)
+      filter_child(key_stack.back().str(), 0);
+    break;
+
+  case json_token::v_pair:
+    filter_pending = true;
+    break;
+
+  case json_token::v_comma:
+    if (!filter_frames.back().object) {
+      filter_child({}, ++filter_frames.back().index);
+      filter_pending = true;
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+bool jsonparser::json_parser::filter_value() {
+  filter_pending = false;
+  switch (lex.type()) {
+  case json_token::object_starts:
+  case json_token::array_starts:
+    if (child_whole || child_alive)
+      return true;
+    break;
+  case json_token::v_string:
+  case json_token::v_number:
+  case json_token::v_true:
+  case json_token::v_false:
+  case json_token::v_null:
+    // A scalar is only kept if a path ends at it.
+    if (child_whole)
+      return true;
+    break;
+  default:
+    // Not a value, let the automaton report it.
+    return true;
+  }
+
+  _skipped = true;
+  if (lex.skip_value())
+    return true;
+  // Cut by the end of pushed input: the value is skipped again from its
+  // start.
+  if (lex.starved())
+    filter_pending = true;
+  return false;
+}
+
+// Keys are interned straight from the input; a key seen before costs a hash
+// and a compare, no allocation.
+bool jsonparser::json_parser::shift_key() {
+  std::string_view text = lex.view();
+  if (lex.span().flags & (span_escaped | span_invalid)) {
+    if (!lex.materialize(scratch))
+      return false;
+    text = scratch;
+  }
+  key_stack.push_back(key_table->intern(text));
+  return true;
+}
+
+void jsonparser::json_parser::reduce(int code) {
+  int reduce_production = -code;
+  JSON_STATS(_stats.reduces++; _stats.productions[reduce_production]++);
+
+  // Reduce Stack
+  reduce_stack(reduce_production);
+
+  //   0:         S' -> JSON
+  //   1:       JSON -> OBJECT
+  //   2:       JSON -> ARRAY
+  //   3:      ARRAY -> [ ]
+  //   4:      ARRAY -> [ ELEMENTS ]
+  //   5:     OBJECT -> { }
+  //   6:     OBJECT -> { MEMBERS }
+  //   7:    MEMBERS -> PAIR
+  //   8:    MEMBERS -> PAIR , MEMBERS
+  //   9:       PAIR -> v_string : VALUE
+  //  10:   ELEMENTS -> VALUE
+  //  11:   ELEMENTS -> VALUE , ELEMENTS
+  //  12:      VALUE -> v_string
+  //  13:      VALUE -> v_number
+  //  14:      VALUE -> OBJECT
+  //  15:      VALUE -> ARRAY
+  //  16:      VALUE -> true
+  //  17:      VALUE -> false
+  //  18:      VALUE -> null
+
+  switch (reduce_production) {
+    // case 0:
+    // case 1:
+    // case 2:
+
+  case 3:
+#ifndef CONFIG_ALLOCATOR
+    values.push_back(jarray(new json_array(resource)));
+#else
+    values.push_back(_arena.make<json_array>(resource));
+#endif
+    break;
+
+  case 4:
+    // ELEMENTS is right recursive, so elements were appended last to first.
+    std::reverse(((json_array *)&*values.back())->array.begin(),
+                 ((json_array *)&*values.back())->array.end());
+    break;
+
+  case 5:
+#ifndef CONFIG_ALLOCATOR
+    values.push_back(jobject(new json_object(resource)));
+    ((json_object *)&*values.back())->key_table = key_table;
+#else
+    values.push_back(_arena.make<json_object>(resource));
+#endif
+    break;
+
+  case 6:
+    // Same for MEMBERS.
+    std::reverse(((json_object *)&*values.back())->keyvalue.begin(),
+                 ((json_object *)&*values.back())->keyvalue.end());
+    break;
+
+  case 7: {
+#ifndef CONFIG_ALLOCATOR
+    auto jo = jobject(new json_object(resource));
+    jo->key_table = key_table;
+#else
+    auto jo = _arena.make<json_object>(resource);
+#endif
+    if (values.back() == nullptr) {
+      // Skipped by the path filter.
+    } else if (!(_skip_literal && values.back()->is_string()))
+      jo->keyvalue.push_back({key_stack.back(), values.back()});
+#ifndef CONFIG_ALLOCATOR
+    else
+      jo->keyvalue.push_back(
+          {key_stack.back(), std::shared_ptr<json_string>(new json_string(
+                                 std::pmr::string(resource)))});
+#else
+    else
+      jo->keyvalue.push_back(
+          {key_stack.back(),
+           _arena.make<json_string>(std::pmr::string(resource))});
+#endif
+    values.pop_back();
+    values.push_back(jo);
+    key_stack.pop_back();
+  } break;
+
+  case 8: {
+    auto jo = values.back();
+    values.pop_back();
+    if (values.back() == nullptr) {
+      // Skipped by the path filter.
+    } else if (!(_skip_literal && values.back()->is_string()))
+      ((json_object *)&*jo)
+          ->keyvalue.push_back({key_stack.back(), values.back()});
+#ifndef CONFIG_ALLOCATOR
+    else
+      ((json_object *)&*jo)
+          ->keyvalue.push_back({key_stack.back(),
+                                std::shared_ptr<json_string>(new json_string(
+                                    std::pmr::string(resource)))});
+#else
+    else
+      ((json_object *)&*jo)
+          ->keyvalue.push_back(
+              {key_stack.back(),
+               _arena.make<json_string>(std::pmr::string(resource))});
+#endif
+    values.pop_back();
+    values.push_back(jo);
+    key_stack.pop_back();
+  } break;
+
+  case 9:
+    break;
+
+  case 10: {
+#ifndef CONFIG_ALLOCATOR
+    auto ja = jarray(new json_array(resource));
+#else
+    auto ja = _arena.make<json_array>(resource);
+#endif
+    if (values.back() && !(_skip_literal && values.back()->is_string()))
+      ja->array.push_back(values.back());
+    values.pop_back();
+    values.push_back(ja);
+  } break;
+
+  case 11: {
+    auto ja = values.back();
+    values.pop_back();
+    if (values.back() && !(_skip_literal && values.back()->is_string()))
+      ((json_array *)&*ja)->array.push_back(values.back());
+    values.pop_back();
+    values.push_back(ja);
+  } break;
+
+  case 12:
+#ifndef CONFIG_ALLOCATOR
+    values.push_back(std::shared_ptr<json_string>(
+        new json_string(std::move(contents.back()))));
+#else
+    values.push_back(_arena.make<json_string>(std::move(contents.back())));
+#endif
+    contents.pop_back();
+    break;
+
+  case 13:
+#ifndef CONFIG_ALLOCATOR
+    values.push_back(std::shared_ptr<json_numeric>(
+        new json_numeric(numbers.back(), std::move(contents.back()))));
+#else
+    values.push_back(
+        _arena.make<json_numeric>(numbers.back(), std::move(contents.back())));
+#endif
+    numbers.pop_back();
+    contents.pop_back();
+    break;
+
+    // case 14:
+    // case 15:
+
+  case 16:
+#ifndef CONFIG_ALLOCATOR
+    values.push_back(std::shared_ptr<json_state>(
+        new json_state(jsonparser::json_token::v_true)));
+#else
+    values.push_back(_arena.make<json_state>(json_token::v_true));
+#endif
+    break;
+
+  case 17:
+#ifndef CONFIG_ALLOCATOR
+    values.push_back(std::shared_ptr<json_state>(
+        new json_state(jsonparser::json_token::v_false)));
+#else
+    values.push_back(_arena.make<json_state>(json_token::v_false));
+#endif
+    break;
+
+  case 18:
+    if (_skipped) {
+      values.push_back(nullptr);
+      _skipped = false;
+      break;
+    }
+#ifndef CONFIG_ALLOCATOR
+    values.push_back(std::shared_ptr<json_state>(
+        new json_state(jsonparser::json_token::v_null)));
+#else
+    values.push_back(_arena.make<json_state>(json_token::v_null));
+#endif
+    break;
+  }
+  JSON_STATS(charge(_stats.build_cycles));
+}
+
+#ifdef CONFIG_STATS
+jsonparser::json_stats jsonparser::json_parser::stats() const {
+  json_stats s = _stats;
+  // Blocks are waited for inside next(), count that as io only.
+  s.lex_cycles -= std::min(s.lex_cycles, s.io_cycles);
+  s.input_bytes = lex.position();
+
+  const size_t *p = s.productions;
+  s.objects = p[5] + p[7];
+  s.arrays = p[3] + p[10];
+  s.strings = p[12];
+  s.numbers = p[13];
+  s.literals = p[16] + p[17] + p[18] - std::min(p[18], s.skipped);
+#ifdef CONFIG_ALLOCATOR
+  s.arena_reserved = _arena.reserved();
+  s.arena_used = _arena.used();
+#endif
+  return s;
+}
+
+std::ostream &jsonparser::json_stats::print(std::ostream &os) const {
+  uint64_t total = io_cycles + lex_cycles + shift_cycles + build_cycles;
+  auto share = [&](uint64_t cycles) {
+    return total ? 100.0 * cycles / total : 0.0;
+  };
+  char line[160];
+  auto put = [&](const char *fmt, auto... args) {
+    snprintf(line, sizeof(line), fmt, args...);
+    os << line;
+  };
+
+  put("input      %12zu bytes, %zu refreshes reading %zu bytes\n",
+      input_bytes, refreshes, bytes_read);
+  put("tokens     %12zu, %zu values skipped\n", tokens, skipped);
+  put("automaton  %12zu shifts, %zu reduces\n", shifts, reduces);
+  put("nodes      %12zu objects, %zu arrays, %zu strings, %zu numbers, "
+      "%zu literals\n",
+      objects, arrays, strings, numbers, literals);
+  put("arena      %12zu bytes reserved, %zu used\n", arena_reserved,
+      arena_used);
+  put("io         %12llu cycles %5.1f%%\n", (unsigned long long)io_cycles,
+      share(io_cycles));
+  put("lex        %12llu cycles %5.1f%%\n", (unsigned long long)lex_cycles,
+      share(lex_cycles));
+  put("shift      %12llu cycles %5.1f%%\n", (unsigned long long)shift_cycles,
+      share(shift_cycles));
+  put("build      %12llu cycles %5.1f%%\n", (unsigned long long)build_cycles,
+      share(build_cycles));
+  return os;
+}
+#endif
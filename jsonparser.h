@@ -1,264 +1,803 @@
-#ifndef JSONPARSER_H
-#define JSONPARSER_H
-
-#include <algorithm>
-#include <fstream>
-#include <map>
-#include <memory>
-#include <ostream>
-#include <stack>
-#include <string>
-#include <tuple>
-#include <vector>
-
-
-#define CONFIG_ALLOCATOR
-#define CONFIG_STABLE
-
-namespace jsonparser {
-
-typedef enum class _json_token {
-  none = 0,
-  json_nt_json,
-  json_nt_array,
-  json_nt_object,
-  json_nt_members,
-  json_nt_pair,
-  json_nt_elements,
-  json_nt_value,
-  object_starts, // {
-  object_ends,   // }
-  v_comma,       // ,
-  v_pair,        // :
-  array_starts,  // [
-  array_ends,    // ]
-  v_true,        // true
-  v_false,       // false
-  v_null,        // null
-  v_string,      // "(\\(["/bfnrt]|u{Hex}{Hex}{Hex}{Hex}))*"
-  v_number,      // \-?(0|[1-9]\d*)(\.\d+)?([Ee][+-]?\d+)?
-  eof,
-  error,
-} json_token;
-
-#ifdef CONFIG_ALLOCATOR
-///===-----------------------------------------------------------------------===
-///
-///               Json Allocator
-///
-///===-----------------------------------------------------------------------===
-
-template <typename type> class json_allocator {
-  size_t capacity;
-
-  using pointer = type *;
-  using value_size = /*alignas(alignof(type))*/ unsigned char[sizeof(type)];
-
-  class allocator_node {
-  public:
-    value_size value;
-    constexpr pointer rep() { return reinterpret_cast<pointer>(value); }
-  };
-
-  std::vector<std::unique_ptr<allocator_node[]>> alloc;
-  int count;
-
-public:
-  json_allocator(size_t capacity) : capacity(capacity), count(0) {
-    alloc.push_back(std::unique_ptr<allocator_node[]>(
-        std::move(new allocator_node[capacity])));
-    count = 0;
-  }
-
-  ~json_allocator() {
-    for (int i = 0; i < alloc.size() - 1; i++)
-      for (int j = 0; j < capacity; j++)
-        alloc[i][j].rep()->type::~type();
-    for (int j = 0; j < count; j++)
-      alloc.back()[j].rep()->type::~type();
-  }
-
-  template <typename... Args> pointer allocate(Args &&... args) {
-    if (count == capacity) {
-      alloc.push_back(std::unique_ptr<allocator_node[]>(
-          std::move(new allocator_node[capacity])));
-      count = 0;
-    }
-    pointer ptr = alloc.back()[count++].rep();
-    new (ptr) type(std::forward<Args>(args)...);
-    return ptr;
-  }
-};
-#endif
-
-///===-----------------------------------------------------------------------===
-///
-///               Json Lexer
-///
-///===-----------------------------------------------------------------------===
-
-class json_lexer {
-  json_token curtok;
-  std::string curstr;
-
-  long long file_size;
-  long long read_size = 0;
-  long long buffer_size;
-  long long current_block_size = 0;
-  char *buffer;
-  char *pointer = nullptr;
-
-  std::ifstream ifs;
-
-  bool appendable = true;
-
-public:
-  json_lexer(std::string file_path, long long buffer_size = 1024 * 1024 * 32);
-  ~json_lexer();
-
-  bool next();
-
-  inline json_token type() const;
-  inline std::string str();
-
-  const char *gbuffer() const;
-
-  std::ifstream &stream() { return ifs; }
-
-  long long filesize() const { return file_size; }
-  long long readsize() const { return read_size; }
-
-  long long position() const {
-    return read_size - current_block_size + (pointer - buffer);
-  }
-
-private:
-  void buffer_refresh();
-  bool require_refresh();
-  char next_ch();
-  void prev();
-};
-
-///===-----------------------------------------------------------------------===
-///
-///               Json Parser
-///
-///===-----------------------------------------------------------------------===
-
-class json_value {
-  int type;
-
-public:
-  json_value(int type) : type(type) {}
-
-  bool is_object() const { return type == 0; }
-  bool is_array() const { return type == 1; }
-  bool is_numeric() const { return type == 2; }
-  bool is_string() const { return type == 3; }
-  bool is_keyword() const { return type == 4; }
-
-  virtual std::ostream &print(std::ostream &os, bool format = false,
-                              std::string indent = "") const = 0;
-};
-
-#ifndef CONFIG_ALLOCATOR
-using jvalue = std::shared_ptr<json_value>;
-#else
-using jvalue = json_value *;
-#endif
-
-class json_object : public json_value {
-public:
-  json_object() : json_value(0) {}
-  std::vector<std::pair<std::string, jvalue>> keyvalue;
-
-  virtual std::ostream &print(std::ostream &os, bool format = false,
-                              std::string indent = "") const;
-};
-
-class json_array : public json_value {
-public:
-  json_array() : json_value(1) {}
-  std::vector<jvalue> array;
-
-  virtual std::ostream &print(std::ostream &os, bool format = false,
-                              std::string indent = "") const;
-};
-
-#ifndef CONFIG_ALLOCATOR
-using jobject = std::shared_ptr<json_object>;
-using jarray = std::shared_ptr<json_array>;
-#else
-using jobject = json_object *;
-using jarray = json_array *;
-#endif
-
-class json_numeric : public json_value {
-public:
-  json_numeric(std::string num) : json_value(2), numstr(std::move(num)) {}
-  std::string numstr;
-
-  bool is_integer = false;
-  virtual std::ostream &print(std::ostream &os, bool format = false,
-                              std::string indent = "") const;
-};
-
-class json_string : public json_value {
-public:
-  json_string(std::string str) : json_value(3), str(std::move(str)) {}
-  std::string str;
-
-  virtual std::ostream &print(std::ostream &os, bool format = false,
-                              std::string indent = "") const;
-};
-
-class json_state : public json_value {
-public:
-  json_state(json_token token) : json_value(4), type(token) {}
-  json_token type;
-
-  virtual std::ostream &print(std::ostream &os, bool format = false,
-                              std::string indent = "") const;
-};
-
-class json_parser {
-  json_lexer lex;
-  jvalue _entry;
-  bool _skip_literal = false;
-  bool _error = false;
-  bool _reduce = false;
-
-#ifdef CONFIG_ALLOCATOR
-  json_allocator<json_array> jarray_pool;
-  json_allocator<json_object> jobject_pool;
-  json_allocator<json_string> jstring_pool;
-  json_allocator<json_numeric> jnumeric_pool;
-  json_allocator<json_state> jstate_pool;
-#endif
-
-public:
-  json_parser(std::string file_path, size_t pool_capacity = 1024 * 256);
-
-  bool step();
-  bool &skip_literal() { return _skip_literal; }
-  bool error() const { return _error; }
-
-  long long filesize() const { return lex.filesize(); }
-  long long readsize() const { return lex.readsize(); }
-  long long position() const { return lex.position(); }
-
-  jvalue entry() { return _entry; }
-
-  bool reduce_before() { return _reduce; }
-  jvalue latest_reduce() { return values.top(); }
-
-private:
-  std::stack<std::string> contents;
-  std::stack<int> stack;
-  std::stack<jvalue> values;
-  void reduce(int code);
-};
-
-} // namespace jsonparser
-
+#ifndef JSONPARSER_H
+#define JSONPARSER_H
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <ostream>
+#include <stack>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "jsonindex.h"
+#include "jsonnumber.h"
+#include "jsonpath.h"
+#include "jsonsource.h"
+#include "jsonutf8.h"
+
+#define CONFIG_ALLOCATOR
+#define CONFIG_STABLE
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CONFIG_MMAP
+#endif
+
+// Counters and phase timers, see json_stats. Off by default; also set by
+// cmake -DCONFIG_STATS=ON.
+// #define CONFIG_STATS
+
+#ifdef CONFIG_STATS
+#define JSON_STATS(...) __VA_ARGS__
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include <chrono>
+#else
+#define JSON_STATS(...)
+#endif
+
+namespace jsonparser {
+
+typedef enum class _json_token {
+  none = 0,
+  json_nt_json,
+  json_nt_array,
+  json_nt_object,
+  json_nt_members,
+  json_nt_pair,
+  json_nt_elements,
+  json_nt_value,
+  object_starts, // {
+  object_ends,   // }
+  v_comma,       // ,
+  v_pair,        // :
+  array_starts,  // [
+  array_ends,    // ]
+  v_true,        // true
+  v_false,       // false
+  v_null,        // null
+  v_string,      // "(\\(["/bfnrt]|u{Hex}{Hex}{Hex}{Hex}))*"
+  v_number,      // \-?(0|[1-9]\d*)(\.\d+)?([Ee][+-]?\d+)?
+  eof,
+  error,
+} json_token;
+
+typedef enum class _json_input_mode {
+  buffered, // read through a block buffer, works for pipes
+  mapped,   // mmap the whole file, falls back to buffered if it can't
+} json_input_mode;
+
+typedef enum class _json_buffer_mode {
+  copy,   // the parser keeps its own copy of the input
+  borrow, // no copy, the caller keeps the input alive as long as the parser
+} json_buffer_mode;
+
+typedef enum class _json_reset_mode {
+  release, // free every value of the previous document, all at once
+  keep,    // keep them valid, new nodes are added to the same arena
+} json_reset_mode;
+
+#ifdef CONFIG_STATS
+///===-----------------------------------------------------------------------===
+///
+///               Json Stats
+///
+///===-----------------------------------------------------------------------===
+
+// Timestamp for the phase timers: TSC ticks on x86, nanoseconds elsewhere.
+inline uint64_t json_cycles() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+// What a parser did since it was built or last reset, see
+// json_parser::stats(). The four phases don't overlap: time in the lexer
+// waiting for a block is io, not lex.
+struct json_stats {
+  // Lexer
+  size_t tokens = 0;
+  size_t skipped = 0;    // values skipped by the path filter
+  size_t refreshes = 0;  // blocks read or pieces fed
+  size_t bytes_read = 0; // by those
+  size_t input_bytes = 0;
+
+  // Automaton
+  size_t shifts = 0;
+  size_t reduces = 0;
+  size_t productions[19] = {}; // reduces by grammar production
+
+  // Nodes built
+  size_t objects = 0;
+  size_t arrays = 0;
+  size_t strings = 0;
+  size_t numbers = 0;
+  size_t literals = 0;
+  size_t arena_reserved = 0;
+  size_t arena_used = 0;
+
+  // Phases, in json_cycles() units
+  uint64_t io_cycles = 0;    // waiting for a block and joining it on
+  uint64_t lex_cycles = 0;   // finding the next token, skipping values
+  uint64_t shift_cycles = 0; // copying strings and numbers, interning keys
+  uint64_t build_cycles = 0; // reduces: allocating and linking nodes
+
+  std::ostream &print(std::ostream &os) const;
+};
+#endif
+
+#ifdef CONFIG_ALLOCATOR
+///===-----------------------------------------------------------------------===
+///
+///               Json Arena
+///
+///===-----------------------------------------------------------------------===
+
+// Monotonic memory for the nodes of a parse and the strings and vectors inside
+// them. Blocks start at initial_block bytes and double up to max_block; larger
+// requests get a block of their own. Nothing is freed one by one and no node
+// destructor ever runs: reset() takes everything back at once.
+class json_arena : public std::pmr::memory_resource {
+  struct block {
+    char *data;
+    size_t size;
+  };
+  std::vector<block> blocks;
+  char *cur = nullptr;
+  char *end = nullptr;
+  size_t next_block;
+  size_t _reserved = 0;
+  size_t _used = 0;
+
+  void *grow(size_t size, size_t align);
+
+protected:
+  void *do_allocate(size_t size, size_t align) override {
+    return bump(size, align);
+  }
+  void do_deallocate(void *, size_t, size_t) override {}
+  bool do_is_equal(const memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+
+public:
+  static constexpr size_t max_block = 1024 * 1024 * 64;
+
+  explicit json_arena(size_t initial_block = 1024 * 4)
+      : next_block(std::max<size_t>(initial_block, 64)) {}
+  ~json_arena();
+
+  json_arena(const json_arena &) = delete;
+  json_arena &operator=(const json_arena &) = delete;
+
+  void *bump(size_t size, size_t align) {
+    char *p = (char *)(((uintptr_t)cur + align - 1) & ~(uintptr_t)(align - 1));
+    if (p > end || size > (size_t)(end - p))
+      return grow(size, align);
+    cur = p + size;
+    _used += size;
+    return p;
+  }
+
+  template <typename type, typename... Args> type *make(Args &&... args) {
+    return new (bump(sizeof(type), alignof(type)))
+        type(std::forward<Args>(args)...);
+  }
+
+  // Forget every allocation. The largest block is kept for the next
+  // document, the others are freed.
+  void reset();
+
+  // Bytes held in blocks, and bytes handed out since the last reset().
+  size_t reserved() const { return _reserved; }
+  size_t used() const { return _used; }
+};
+#endif
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Lexer
+///
+///===-----------------------------------------------------------------------===
+
+// Flags of a json_span.
+enum json_span_flags : unsigned {
+  span_escaped = 1, // string contains escape sequences
+  span_invalid = 2, // string isn't valid UTF-8, see json_utf8_mode::replace
+};
+
+// A token as a slice of the lexer window: string contents without the quotes,
+// or the raw text of any other token. Offsets are only stable until the window
+// is refilled, which happens in buffered mode only.
+struct json_span {
+  size_t offset;
+  size_t length;
+  unsigned flags;
+};
+
+// Decode the escape sequences of a JSON string body into UTF-8, including
+// \uXXXX surrogate pairs. Returns false on a malformed escape.
+bool json_unescape(const char *data, size_t size, std::string &out);
+
+class json_lexer {
+  json_token curtok;
+  json_span curspan = {0, 0, 0};
+  json_number curnum;
+
+  long long file_size;
+  long long read_size = 0;
+  long long buffer_size;
+  long long current_block_size = 0;
+  char *buffer;
+  char *pointer = nullptr;
+
+  // Block buffer of a stream or copy of a buffer. Kept by reset(), so a
+  // reused lexer doesn't allocate it again.
+  char *heap = nullptr;
+  long long heap_size = 0;
+  long long block_size = 1024 * 1024 * 32;
+
+  // Stream read-ahead: while the window in heap is lexed, a background
+  // thread reads the next block into spare, after headroom bytes left free
+  // for the tail of a token cut by the block boundary. The two buffers swap
+  // at every refresh.
+  static constexpr long long headroom = 1024 * 64;
+  char *spare = nullptr;
+  long long spare_size = 0;
+  std::future<long long> ahead;
+
+  // Blocks of a stream come from source, see json_block_source. A failed
+  // read ends the input with an error.
+  std::unique_ptr<json_block_source> source;
+  long long requested = 0;
+  bool source_failed = false;
+
+  bool appendable = true;
+
+  json_utf8_mode utf8 = json_utf8_mode::reject;
+
+  // Who owns the window: the block buffer of source, an mmap of the file, a copy
+  // of the caller's buffer, the caller's buffer itself, or pieces of input
+  // pushed with append().
+  enum class window_kind { stream, mapped, copied, borrowed, pushed };
+  window_kind window = window_kind::stream;
+
+  // Pushed input: no more comes after finish(). Until then, running out of
+  // bytes inside a token or between tokens suspends the lexer instead of
+  // ending the input, and it waits for wanted unlexed bytes before trying
+  // again, so a long token is rescanned a logarithmic number of times.
+  bool finished = true;
+  bool suspended = false;
+  long long wanted = 0;
+
+  // Stage one. The window [buffer, buffer + current_block_size) is indexed
+  // one slice at a time; next() walks the structural offsets.
+  json_structural_index index;
+  const char *slice = nullptr;
+  const char *indexed = nullptr;
+  size_t cursor = 0;
+
+#ifdef CONFIG_STATS
+  json_stats *counters = nullptr;
+#endif
+
+public:
+  json_lexer(std::string file_path, long long buffer_size = 1024 * 1024 * 32);
+  json_lexer(std::string file_path, json_input_mode mode,
+             long long buffer_size = 1024 * 1024 * 32);
+  json_lexer(std::unique_ptr<json_block_source> source,
+             long long buffer_size = 1024 * 1024 * 32);
+  json_lexer(const char *data, size_t size, json_buffer_mode mode);
+  json_lexer(std::string_view data, json_buffer_mode mode)
+      : json_lexer(data.data(), data.size(), mode) {}
+  // Input pushed with append().
+  json_lexer();
+  ~json_lexer();
+
+  // Start over on another input, keeping the block buffer and the index.
+  void reset(std::string file_path,
+             json_input_mode mode = json_input_mode::buffered);
+  void reset(const char *data, size_t size, json_buffer_mode mode);
+  void reset(std::unique_ptr<json_block_source> source);
+  void reset();
+
+  // Pushed input: add the next piece, copied, or say there is none left.
+  void append(const char *data, size_t size);
+  void finish();
+
+  // The last next() or skip_value() failed only because pushed input ran
+  // out. The read position went back to where the cut token starts, which
+  // is lexed again once more input is appended.
+  bool starved() const { return suspended; }
+  // Enough input arrived since then to make another try worthwhile.
+  bool ready() const {
+    return finished || current_block_size - (pointer - buffer) >= wanted;
+  }
+  // Input is pushed and more of it may come.
+  bool starving() const { return window == window_kind::pushed && !finished; }
+
+  bool next();
+
+  // How string contents are checked, see json_utf8_mode. Kept by reset().
+  json_utf8_mode &utf8_mode() { return utf8; }
+
+  json_token type() const { return curtok; }
+  json_span span() const { return curspan; }
+
+  // Value of the current v_number token, decoded while it was matched.
+  const json_number &number() const { return curnum; }
+
+  // Raw text of the current token; escapes are left in place.
+  std::string_view view() const {
+    return std::string_view(buffer + curspan.offset, curspan.length);
+  }
+
+  // Text of the current token with escapes decoded, and invalid UTF-8
+  // replaced if the span says so. Returns false on a malformed escape
+  // sequence.
+  bool materialize(std::string &out) const;
+  std::string str() const;
+
+  // Consume the value starting at the current token without lexing it: for
+  // an object or array, walk the structural index to the matching close
+  // bracket. Only quotes and bracket depth are checked inside. The value then
+  // reads as a v_null token. Returns false if the input ends first.
+  bool skip_value();
+
+  // Make the current token one the input doesn't hold, of zero length at the
+  // read position. See json_parser::fragment().
+  void imply(json_token token) {
+    curtok = token;
+    curspan = {(size_t)(pointer - buffer), 0, 0};
+  }
+
+  const char *gbuffer() const;
+
+  json_block_source *block_source() { return source.get(); }
+  // The source failed to read, or found its input corrupt: the input ended
+  // there, and the parse with it.
+  bool source_error() const { return source_failed; }
+
+  long long filesize() const { return file_size; }
+  long long readsize() const { return read_size; }
+
+#ifdef CONFIG_STATS
+  // Count refreshes, io time and skipped values into stats.
+  void count(json_stats *stats) { counters = stats; }
+#endif
+
+  long long position() const {
+    return read_size - current_block_size + (pointer - buffer);
+  }
+
+  // Offset of the current token in the input.
+  long long token_position() const {
+    return read_size - current_block_size + curspan.offset;
+  }
+
+private:
+  void attach(const std::string &file_path, json_input_mode mode);
+  void attach(const char *data, size_t size, json_buffer_mode mode);
+  void attach(std::unique_ptr<json_block_source> blocks);
+  void attach();
+  void release();
+  char *heap_buffer(long long size);
+  char *spare_buffer(long long size);
+  void read_ahead();
+  bool map_file(const std::string &file_path);
+  void buffer_refresh(const char *keep);
+  bool require_refresh();
+  bool starve(const char *keep);
+  const char *next_structural();
+};
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Keys
+///
+///===-----------------------------------------------------------------------===
+
+// One distinct object key of a parse, hashed once.
+struct json_key_entry {
+  std::string str;
+  size_t hash;
+};
+
+// Handle to an interned object key. Two keys from the same table are equal
+// exactly when their handles are.
+class json_key {
+  const json_key_entry *rep = nullptr;
+
+public:
+  json_key() = default;
+  explicit json_key(const json_key_entry *rep) : rep(rep) {}
+
+  const std::string &str() const { return rep->str; }
+  operator const std::string &() const { return rep->str; }
+  size_t size() const { return rep->str.size(); }
+  size_t hash() const { return rep->hash; }
+  bool valid() const { return rep != nullptr; }
+
+  bool operator==(json_key other) const { return rep == other.rep; }
+  bool operator!=(json_key other) const { return rep != other.rep; }
+  bool operator==(std::string_view other) const { return rep->str == other; }
+  bool operator!=(std::string_view other) const { return rep->str != other; }
+};
+
+inline std::ostream &operator<<(std::ostream &os, json_key key) {
+  return os << key.str();
+}
+
+// Stores every distinct key of a parse once; objects hold json_key handles.
+class json_key_table {
+  std::deque<json_key_entry> entries;
+  std::vector<json_key_entry *> slots;
+
+  void grow();
+
+public:
+  json_key_table() : slots(64) {}
+
+  static size_t hash(std::string_view str) {
+    return std::hash<std::string_view>()(str);
+  }
+
+  // The handle of str, added to the table if new.
+  json_key intern(std::string_view str);
+
+  // The handle of str, or an invalid key if no object of the parse has it.
+  json_key find(std::string_view str) const;
+
+  size_t size() const { return entries.size(); }
+};
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Parser
+///
+///===-----------------------------------------------------------------------===
+
+class json_value {
+  int type;
+
+public:
+  json_value(int type) : type(type) {}
+
+  bool is_object() const { return type == 0; }
+  bool is_array() const { return type == 1; }
+  bool is_numeric() const { return type == 2; }
+  bool is_string() const { return type == 3; }
+  bool is_keyword() const { return type == 4; }
+
+  virtual std::ostream &print(std::ostream &os, bool format = false,
+                              std::string indent = "") const = 0;
+};
+
+#ifndef CONFIG_ALLOCATOR
+using jvalue = std::shared_ptr<json_value>;
+#else
+using jvalue = json_value *;
+#endif
+
+class json_object : public json_value {
+  // Open addressing table of keyvalue positions + 1, built on the first
+  // find() once the object has more than linear_limit members. Allocated
+  // from the object's memory resource then, so the other objects only carry
+  // the pointer.
+  struct hash_index {
+    size_t indexed; // members when it was built
+    size_t mask;    // number of slots - 1
+    unsigned *slots() { return (unsigned *)(this + 1); }
+  };
+  mutable hash_index *index = nullptr;
+
+  void build_index() const;
+  void release_index() const;
+
+public:
+  explicit json_object(
+      std::pmr::memory_resource *mr = std::pmr::get_default_resource())
+      : json_value(0), keyvalue(mr) {}
+  ~json_object() { release_index(); }
+
+  json_object(const json_object &) = delete;
+  json_object &operator=(const json_object &) = delete;
+
+  // In document order once the object is reduced.
+  std::pmr::vector<std::pair<json_key, jvalue>> keyvalue;
+
+#ifndef CONFIG_ALLOCATOR
+  // Nodes may outlive the parser here, so they share its key table.
+  std::shared_ptr<const json_key_table> key_table;
+#endif
+
+  // Objects this small are scanned, the hash index isn't worth it.
+  static constexpr size_t linear_limit = 16;
+
+  // Value of the first member named key, or nullptr. The index notices
+  // members being added or removed, but not keys being renamed in place:
+  // call reindex() after that. Not safe to call concurrently on the same
+  // object.
+  jvalue find(std::string_view key) const;
+  jvalue operator[](std::string_view key) const { return find(key); }
+
+  // Same, comparing handles only. key must come from the same parse, see
+  // json_parser::key().
+  jvalue find(json_key key) const;
+  jvalue operator[](json_key key) const { return find(key); }
+  void reindex() { release_index(); }
+
+  virtual std::ostream &print(std::ostream &os, bool format = false,
+                              std::string indent = "") const;
+};
+
+class json_array : public json_value {
+public:
+  explicit json_array(
+      std::pmr::memory_resource *mr = std::pmr::get_default_resource())
+      : json_value(1), array(mr) {}
+
+  // In document order once the array is reduced.
+  std::pmr::vector<jvalue> array;
+
+  virtual std::ostream &print(std::ostream &os, bool format = false,
+                              std::string indent = "") const;
+};
+
+#ifndef CONFIG_ALLOCATOR
+using jobject = std::shared_ptr<json_object>;
+using jarray = std::shared_ptr<json_array>;
+#else
+using jobject = json_object *;
+using jarray = json_array *;
+#endif
+
+class json_numeric : public json_value {
+public:
+  json_numeric(json_number value, std::pmr::string num = {})
+      : json_value(2), value(value), numstr(std::move(num)) {}
+  json_number value;
+
+  // Source text. Only kept when asked for (json_parser::keep_number_text())
+  // or when value doesn't hold the number exactly, see json_number::exact().
+  std::pmr::string numstr;
+
+  bool is_integer() const { return value.is_integer(); }
+  virtual std::ostream &print(std::ostream &os, bool format = false,
+                              std::string indent = "") const;
+};
+
+class json_string : public json_value {
+public:
+  json_string(std::pmr::string str) : json_value(3), str(std::move(str)) {}
+  std::pmr::string str;
+
+  virtual std::ostream &print(std::ostream &os, bool format = false,
+                              std::string indent = "") const;
+};
+
+class json_state : public json_value {
+public:
+  json_state(json_token token) : json_value(4), type(token) {}
+  json_token type;
+
+  virtual std::ostream &print(std::ostream &os, bool format = false,
+                              std::string indent = "") const;
+};
+
+class json_tape;
+
+class json_parser {
+  json_lexer lex;
+  jvalue _entry;
+  bool _skip_literal = false;
+  bool _keep_number_text = false;
+  bool _error = false;
+  bool _reduce = false;
+  bool _sequence = false;
+  bool _following = false;
+  bool _implied_open = false;
+  bool _implied_close = false;
+
+#ifdef CONFIG_ALLOCATOR
+  json_arena _arena;
+#endif
+  // Where nodes and their contents live: the arena, or the heap when nodes
+  // are reference counted and may outlive the parser.
+  std::pmr::memory_resource *resource;
+
+public:
+  // arena_block: bytes of the arena's first block, see json_arena.
+  json_parser(std::string file_path, size_t arena_block = 1024 * 4,
+              json_input_mode mode = json_input_mode::buffered);
+  json_parser(const char *data, size_t size, json_buffer_mode mode,
+              size_t arena_block = 1024 * 4);
+  json_parser(std::string_view data, json_buffer_mode mode,
+              size_t arena_block = 1024 * 4)
+      : json_parser(data.data(), data.size(), mode, arena_block) {}
+  // A parser fed its input with feed() and finish().
+  explicit json_parser(size_t arena_block = 1024 * 4);
+  // A parser reading its input from source, a decompressor for instance.
+  // Files given by path are decompressed when they are gzip or zstd.
+  json_parser(std::unique_ptr<json_block_source> source,
+              size_t arena_block = 1024 * 4);
+
+  // Parse another input with this parser. The lexer's buffer, the stacks,
+  // the key table and the arena's memory are kept, so a reused parser barely
+  // allocates; settings such as filter() and sequence() stay too.
+  void reset(std::string file_path,
+             json_input_mode mode = json_input_mode::buffered,
+             json_reset_mode values = json_reset_mode::release);
+  void reset(const char *data, size_t size, json_buffer_mode mode,
+             json_reset_mode values = json_reset_mode::release);
+  void reset(std::string_view data, json_buffer_mode mode,
+             json_reset_mode values = json_reset_mode::release) {
+    reset(data.data(), data.size(), mode, values);
+  }
+  void reset(std::unique_ptr<json_block_source> source,
+             json_reset_mode values = json_reset_mode::release);
+  void reset(json_reset_mode values = json_reset_mode::release);
+
+  // Push parsing of a single document. feed() takes the next piece of it,
+  // copied, and runs the automaton as far as the input goes; a piece may end
+  // anywhere, inside a token too, which is lexed again from its start once
+  // the rest arrives. finish() marks the end of the input and completes the
+  // document into entry(). Both return false on error. Not for sequence().
+  bool feed(const char *data, size_t size);
+  bool feed(std::string_view data) { return feed(data.data(), data.size()); }
+  bool finish();
+
+  // Run the automaton to the end of the document. Returns false on error.
+  bool parse();
+
+  // Parse the document onto a flat tape instead of building json_value
+  // nodes. The tape is appended to, and entry() stays empty. A document too
+  // large for the tape's fields is an error, see json_tape.
+  bool parse(json_tape &tape);
+
+  // Drive a json_handler (see jsonsax.h) with the document's events instead
+  // of building anything. Returns false on error, check error(), or when the
+  // handler stopped the parse. Works with sequence() and fragment(); fails
+  // with filter(), and on pushed input before finish().
+  template <typename handler> bool parse_events(handler &h);
+
+  // Read the document straight into out: a struct declared with JSON_FIELDS,
+  // a std::vector of them, or another type jsonbind.h reads. Keys are matched
+  // at compile time and no nodes are built. Returns false on malformed input
+  // or a value out can't hold, see token_position(). Fails with filter(),
+  // and on pushed input before finish().
+  template <typename T> bool parse_into(T &out);
+
+  // Advance by a single shift or reduce, for incremental callers. Returns
+  // false once the document is accepted or an error occurred.
+  bool step();
+  bool &skip_literal() { return _skip_literal; }
+
+  // Build only the values selected by paths, and the containers leading to
+  // them. Everything else is skipped by the lexer and never allocated. Set
+  // before parsing.
+  void filter(json_path_filter paths);
+  // Keep the source text of every number in json_numeric::numstr.
+  bool &keep_number_text() { return _keep_number_text; }
+  // Strings that aren't valid UTF-8 fail the parse by default, see
+  // json_utf8_mode.
+  json_utf8_mode &utf8() { return lex.utf8_mode(); }
+
+  // Accept a sequence of documents separated by whitespace, as in JSON Lines.
+  // parse() then returns after each document, and more() tells whether
+  // another one follows.
+  bool &sequence() { return _sequence; }
+  bool more() const { return lex.type() != json_token::eof; }
+
+  // Parse a run of array elements, "a, b, c", as the array [a, b, c]: open
+  // and close tell which of its brackets the input leaves out. Lets the
+  // pieces of one big array be parsed apart, see json_array_reader. parse()
+  // only; set before parsing.
+  void fragment(bool open, bool close) {
+    _implied_open = open;
+    _implied_close = close;
+  }
+
+  bool error() const { return _error; }
+  // The error is the input's source failing rather than the JSON, say a
+  // corrupt or truncated gzip file.
+  bool source_error() const { return lex.source_error(); }
+
+  long long filesize() const { return lex.filesize(); }
+  long long readsize() const { return lex.readsize(); }
+  long long position() const { return lex.position(); }
+  long long token_position() const { return lex.token_position(); }
+
+  jvalue entry() { return _entry; }
+
+#ifdef CONFIG_ALLOCATOR
+  // Memory of the nodes built so far. Resetting it between documents of a
+  // sequence reuses its largest block; every value parsed before is gone.
+  json_arena &arena() { return _arena; }
+  const json_arena &arena() const { return _arena; }
+#endif
+
+  // Interned handle of an object key seen in this parse, or an invalid key.
+  // Lets hot lookups compare handles instead of strings.
+  json_key key(std::string_view str) const { return key_table->find(str); }
+  const json_key_table &keys() const { return *key_table; }
+
+#ifdef CONFIG_STATS
+  // Counters of the parses since construction or the last reset().
+  json_stats stats() const;
+#endif
+
+  bool reduce_before() { return _reduce; }
+  jvalue latest_reduce() { return values.back(); }
+
+private:
+  // Used as stacks, vectors keep them contiguous and reserved up front.
+  std::vector<std::pmr::string> contents;
+  std::vector<json_number> numbers;
+  std::vector<json_key> key_stack;
+  std::vector<int> stack;
+  std::vector<jvalue> values;
+
+  std::shared_ptr<json_key_table> key_table;
+  std::string scratch;
+
+#ifdef CONFIG_STATS
+  json_stats _stats;
+  // Phases follow each other, so one timestamp ends a phase and starts the
+  // next: charge() adds the time since the last one to a phase.
+  uint64_t _mark = 0;
+  void charge(uint64_t &cycles) {
+    uint64_t now = json_cycles();
+    cycles += now - _mark;
+    _mark = now;
+  }
+#endif
+
+  // Path filter: one frame per open container, and the verdict for the
+  // value about to be shifted.
+  struct filter_frame {
+    uint64_t alive; // paths matching down to this container
+    size_t index;   // current element, arrays only
+    bool whole;     // selected entirely, nothing inside is filtered
+    bool object;
+  };
+  json_path_filter paths;
+  std::vector<filter_frame> filter_frames;
+  bool filtering = false;
+  bool filter_pending = false;
+  uint64_t child_alive = 0;
+  bool child_whole = true;
+  bool _skipped = false; // the v_null being shifted stands for a skipped value
+
+  // A released key table that grew past this starts over, so documents
+  // with ever new keys don't grow it without bound.
+  static constexpr size_t max_kept_keys = 1024 * 16;
+
+  void reserve_stacks();
+  void restart(json_reset_mode values);
+  bool next();
+  void filter_restart();
+  void filter_shift(int code);
+  void filter_child(std::string_view key, size_t index);
+  bool filter_value();
+  bool shift(int code);
+  bool shift_key();
+  void reduce_stack(int reduce_production);
+  void reduce(int code);
+};
+
+} // namespace jsonparser
+
 #endif
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include "jsonpath.h"
+#include <stdexcept>
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Path Filter
+///
+///===-----------------------------------------------------------------------===
+
+// Digits without a leading zero, as an array index; -1 otherwise.
+static long long parse_index(std::string_view token) {
+  if (token.empty() || token.size() > 18 ||
+      (token[0] == '0' && token.size() > 1))
+    return -1;
+  long long index = 0;
+  for (char c : token) {
+    if (c < '0' || c > '9')
+      return -1;
+    index = index * 10 + (c - '0');
+  }
+  return index;
+}
+
+static jsonparser::json_path_filter::step make_step(std::string key) {
+  jsonparser::json_path_filter::step s;
+  if (key == "*") {
+    s.any = true;
+  } else {
+    s.index = parse_index(key);
+    s.key = std::move(key);
+  }
+  return s;
+}
+
+[[noreturn]] static void malformed(std::string_view path) {
+  throw std::invalid_argument("malformed json path: " + std::string(path));
+}
+
+jsonparser::json_path_filter::json_path_filter(
+    std::initializer_list<std::string_view> paths) {
+  for (auto path : paths)
+    add(path);
+}
+
+void jsonparser::json_path_filter::add(std::string_view path) {
+  if (paths.size() == max_paths)
+    throw std::invalid_argument("too many json paths");
+  if (!path.empty() && path[0] == '$')
+    paths.push_back(parse_jsonpath(path));
+  else
+    paths.push_back(parse_pointer(path));
+}
+
+// RFC 6901: "/a/b", with "~1" for '/' and "~0" for '~' inside a token.
+std::vector<jsonparser::json_path_filter::step>
+jsonparser::json_path_filter::parse_pointer(std::string_view path) {
+  std::vector<step> steps;
+  if (path.empty())
+    return steps;
+  if (path[0] != '/')
+    malformed(path);
+
+  size_t i = 1;
+  while (true) {
+    std::string key;
+    for (; i < path.size() && path[i] != '/'; i++) {
+      if (path[i] != '~') {
+        key += path[i];
+      } else if (i + 1 < path.size() &&
+                 (path[i + 1] == '0' || path[i + 1] == '1')) {
+        key += path[++i] == '0' ? '~' : '/';
+      } else {
+        malformed(path);
+      }
+    }
+    steps.push_back(make_step(std::move(key)));
+    if (i == path.size())
+      return steps;
+    i++;
+  }
+}
+
+// "$", then any of .name .* [n] [*] ['name'] ["name"].
+std::vector<jsonparser::json_path_filter::step>
+jsonparser::json_path_filter::parse_jsonpath(std::string_view path) {
+  std::vector<step> steps;
+  size_t i = 1;
+  while (i < path.size()) {
+    if (path[i] == '.') {
+      size_t start = ++i;
+      while (i < path.size() && path[i] != '.' && path[i] != '[')
+        i++;
+      if (i == start)
+        malformed(path);
+      steps.push_back(make_step(std::string(path.substr(start, i - start))));
+    } else if (path[i] == '[') {
+      size_t close;
+      if (i + 1 < path.size() && (path[i + 1] == '\'' || path[i + 1] == '"')) {
+        char quote = path[i + 1];
+        size_t end = path.find(quote, i + 2);
+        if (end == std::string_view::npos || end + 1 >= path.size() ||
+            path[end + 1] != ']')
+          malformed(path);
+        // A quoted name is always a key, even "*" or "0".
+        step s;
+        s.key = std::string(path.substr(i + 2, end - i - 2));
+        steps.push_back(std::move(s));
+        close = end + 1;
+      } else {
+        close = path.find(']', i);
+        if (close == std::string_view::npos)
+          malformed(path);
+        std::string_view token = path.substr(i + 1, close - i - 1);
+        if (token != "*" && parse_index(token) < 0)
+          malformed(path);
+        step s = make_step(std::string(token));
+        s.index_only = true;
+        steps.push_back(std::move(s));
+      }
+      i = close + 1;
+    } else {
+      malformed(path);
+    }
+  }
+  return steps;
+}
+
+bool jsonparser::json_path_filter::selects_root() const {
+  for (auto &path : paths)
+    if (path.empty())
+      return true;
+  return false;
+}
+
+uint64_t jsonparser::json_path_filter::match_key(uint64_t alive, size_t depth,
+                                                 std::string_view key,
+                                                 bool &whole) const {
+  uint64_t child = 0;
+  whole = false;
+  for (; alive; alive &= alive - 1) {
+    size_t i = __builtin_ctzll(alive);
+    const step &s = paths[i][depth];
+    if (!s.any && (s.index_only || s.key != key))
+      continue;
+    if (paths[i].size() == depth + 1)
+      whole = true;
+    else
+      child |= 1ULL << i;
+  }
+  return child;
+}
+
+uint64_t jsonparser::json_path_filter::match_index(uint64_t alive,
+                                                   size_t depth, size_t index,
+                                                   bool &whole) const {
+  uint64_t child = 0;
+  whole = false;
+  for (; alive; alive &= alive - 1) {
+    size_t i = __builtin_ctzll(alive);
+    const step &s = paths[i][depth];
+    if (!s.any && s.index != (long long)index)
+      continue;
+    if (paths[i].size() == depth + 1)
+      whole = true;
+    else
+      child |= 1ULL << i;
+  }
+  return child;
+}
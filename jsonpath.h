@@ -0,0 +1,75 @@
+#ifndef JSONPATH_H
+#define JSONPATH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace jsonparser {
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Path Filter
+///
+///===-----------------------------------------------------------------------===
+
+// A set of paths selecting the parts of a document worth building. Each path
+// is either a JSON Pointer or a simple JSONPath:
+//
+//   /items/*/id          $.items[*].id
+//   /meta/version        $.meta.version     $['meta']['version']
+//   /items/0             $.items[0]
+//
+// '*' matches any key or index. A pointer token made of digits also matches
+// that array index. The empty pointer "" and "$" select the whole document.
+class json_path_filter {
+public:
+  // One step of a path: a key, an array index, or any child.
+  struct step {
+    std::string key;
+    long long index = -1;    // -1 if key isn't an index
+    bool index_only = false; // [n] in a JSONPath never matches a key
+    bool any = false;
+  };
+
+  // Paths are tracked in a 64-bit set while parsing.
+  static constexpr size_t max_paths = 64;
+
+  json_path_filter() = default;
+  json_path_filter(std::initializer_list<std::string_view> paths);
+
+  // Throws std::invalid_argument on a malformed path or too many paths.
+  void add(std::string_view path);
+
+  size_t size() const { return paths.size(); }
+  bool empty() const { return paths.empty(); }
+
+  // Set of all paths, every one matches the root.
+  uint64_t all() const {
+    return paths.size() == 64 ? ~0ULL : (1ULL << paths.size()) - 1;
+  }
+
+  // True if some path selects the whole document.
+  bool selects_root() const;
+
+  // Of the paths in alive, which all match down to a container at depth, the
+  // ones that still match its child named key (or at index). whole is set if
+  // one of them ends at the child, selecting it entirely.
+  uint64_t match_key(uint64_t alive, size_t depth, std::string_view key,
+                     bool &whole) const;
+  uint64_t match_index(uint64_t alive, size_t depth, size_t index,
+                       bool &whole) const;
+
+private:
+  std::vector<std::vector<step>> paths;
+
+  static std::vector<step> parse_pointer(std::string_view path);
+  static std::vector<step> parse_jsonpath(std::string_view path);
+};
+
+} // namespace jsonparser
+
+#endif
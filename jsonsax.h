@@ -0,0 +1,227 @@
+#ifndef JSONSAX_H
+#define JSONSAX_H
+
+#include <cstdint>
+#include <string_view>
+
+#include "jsonparser.h"
+
+namespace jsonparser {
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Automaton
+///
+///===-----------------------------------------------------------------------===
+
+// LR tables of the grammar listed in json_parser::reduce(). Shared by the DOM
+// parser and the event driver below, which is a template and needs them here.
+// Inline variables, so every translation unit shares one copy.
+namespace detail {
+
+inline constexpr int goto_table[][20] = {
+    {0, 1, 3, 2, 0, 0, 0, 0, 4, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 28},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -1},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -2},
+    {0, 0, 0, 0, 7, 8, 0, 0, 0, 6, 0, 0, 0, 0, 0, 0, 0, 9, 0, 0},
+    {0, 0, 16, 15, 0, 0, 11, 12, 4, 0, 0, 0, 5, 10, 17, 18, 19, 13, 14, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, -5, -5, 0, 0, -5, 0, 0, 0, 0, 0, -5},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, 20, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, -7, 21, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 22, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, -3, -3, 0, 0, -3, 0, 0, 0, 0, 0, -3},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 23, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 24, 0, 0, -10, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, -12, -12, 0, 0, -12, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, -13, -13, 0, 0, -13, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, -14, -14, 0, 0, -14, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, -15, -15, 0, 0, -15, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, -16, -16, 0, 0, -16, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, -17, -17, 0, 0, -17, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, -18, -18, 0, 0, -18, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, -6, -6, 0, 0, -6, 0, 0, 0, 0, 0, -6},
+    {0, 0, 0, 0, 25, 8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 9, 0, 0},
+    {0, 0, 16, 15, 0, 0, 0, 26, 4, 0, 0, 0, 5, 0, 17, 18, 19, 13, 14, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, -4, -4, 0, 0, -4, 0, 0, 0, 0, 0, -4},
+    {0, 0, 16, 15, 0, 0, 27, 12, 4, 0, 0, 0, 5, 0, 17, 18, 19, 13, 14, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, -8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, -9, -9, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -11, 0, 0, 0, 0, 0, 0},
+};
+
+inline constexpr int8_t production[] = {1, 1, 1, 2, 3, 2, 3, 1, 3, 3,
+                                       1, 3, 1, 1, 1, 1, 1, 1, 1};
+
+inline constexpr int8_t group_table[] = {0, 1, 1, 2, 2, 3, 3, 4, 4, 5,
+                                        6, 6, 7, 7, 7, 7, 7, 7, 7};
+
+inline constexpr int accept_index = 28;
+
+// State entered by shifting the v_string of PAIR -> v_string : VALUE, i.e. by
+// an object key.
+inline constexpr int key_state = 9;
+
+// goto_table narrowed to int8 at compile time: 560 bytes, so the whole
+// automaton stays in a handful of cache lines.
+struct action_rows {
+  int8_t row[sizeof(goto_table) / sizeof(goto_table[0])][20];
+};
+
+constexpr action_rows make_action_table() {
+  action_rows table = {};
+  for (size_t i = 0; i < sizeof(goto_table) / sizeof(goto_table[0]); i++)
+    for (size_t j = 0; j < 20; j++) {
+      if (goto_table[i][j] < INT8_MIN || goto_table[i][j] > INT8_MAX)
+        throw "goto_table entry does not fit int8";
+      table.row[i][j] = (int8_t)goto_table[i][j];
+    }
+  return table;
+}
+
+inline constexpr action_rows action_table = make_action_table();
+
+} // namespace detail
+
+inline void json_parser::reduce_stack(int reduce_production) {
+  stack.resize(stack.size() - detail::production[reduce_production]);
+  int group = detail::group_table[reduce_production];
+  stack.push_back(detail::action_table.row[stack.back()][group]);
+}
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Handler
+///
+///===-----------------------------------------------------------------------===
+
+// Receiver of json_parser::parse_events(). Derive from it and hide the events
+// you need; the handler type is a template parameter, so calls are resolved
+// statically and inline into the parse loop.
+//
+// Every event returns false to stop the parse. Views are only valid during the
+// call. Keys and strings arrive unescaped, numbers decoded and with their
+// source text, which is all there is of one that isn't json_number::exact().
+struct json_handler {
+  bool on_start_object() { return true; }
+  bool on_end_object() { return true; }
+  bool on_start_array() { return true; }
+  bool on_end_array() { return true; }
+  bool on_key(std::string_view /* key */) { return true; }
+  bool on_string(std::string_view /* str */) { return true; }
+  bool on_number(const json_number & /* num */, std::string_view /* text */) {
+    return true;
+  }
+  bool on_bool(bool /* value */) { return true; }
+  bool on_null() { return true; }
+};
+
+// The automaton only validates here; events are raised as tokens are shifted,
+// which is document order. Reductions build nothing. Sequences and fragments
+// are followed as in parse().
+template <typename handler> bool json_parser::parse_events(handler &h) {
+  // A filter selects nodes to build, and there are none. Pushed input can cut
+  // a token, which parse() lexes again later; an event can't be taken back.
+  if (filtering || lex.starving()) {
+    _error = true;
+    return false;
+  }
+
+  if (stack.empty())
+    stack.push_back(0);
+
+  if (_implied_open) {
+    _implied_open = false;
+    lex.imply(json_token::array_starts);
+  } else if (!_following && !lex.next()) {
+    _error = true;
+    return false;
+  }
+  _following = false;
+
+  while (true) {
+    int code = detail::action_table.row[stack.back()][(int)lex.type()];
+
+    if (code == 0 && _sequence)
+      code = detail::action_table.row[stack.back()][(int)json_token::eof];
+
+    if (code == 0 && _implied_close && lex.type() == json_token::eof) {
+      _implied_close = false;
+      lex.imply(json_token::array_ends);
+      continue;
+    }
+
+    if (code < 0) {
+      reduce_stack(-code);
+      continue;
+    }
+
+    if (code == detail::accept_index) {
+      // The next document's first token, or eof, is current.
+      if (_sequence) {
+        stack.clear();
+        _following = true;
+      }
+      return true;
+    }
+
+    if (code == 0) {
+      _error = true;
+      return false;
+    }
+    stack.push_back(code);
+
+    bool go = true;
+    switch (lex.type()) {
+    case json_token::object_starts:
+      go = h.on_start_object();
+      break;
+    case json_token::object_ends:
+      go = h.on_end_object();
+      break;
+    case json_token::array_starts:
+      go = h.on_start_array();
+      break;
+    case json_token::array_ends:
+      go = h.on_end_array();
+      break;
+    case json_token::v_string: {
+      std::string_view text = lex.view();
+      if (lex.span().flags & (span_escaped | span_invalid)) {
+        if (!lex.materialize(scratch)) {
+          _error = true;
+          return false;
+        }
+        text = scratch;
+      }
+      go = code == detail::key_state ? h.on_key(text) : h.on_string(text);
+    } break;
+    case json_token::v_number:
+      go = h.on_number(lex.number(), lex.view());
+      break;
+    case json_token::v_true:
+      go = h.on_bool(true);
+      break;
+    case json_token::v_false:
+      go = h.on_bool(false);
+      break;
+    case json_token::v_null:
+      go = h.on_null();
+      break;
+    default:
+      break;
+    }
+
+    if (!go)
+      return false;
+
+    if (!lex.next()) {
+      _error = true;
+      return false;
+    }
+  }
+}
+
+} // namespace jsonparser
+
+#endif
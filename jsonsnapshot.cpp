@@ -0,0 +1,148 @@
+#include "jsonsnapshot.h"
+#include <filesystem>
+#include <fstream>
+#include <memory.h>
+#include <stdexcept>
+
+#ifdef CONFIG_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Snapshot
+///
+///===-----------------------------------------------------------------------===
+
+namespace {
+
+const char snapshot_magic[8] = {'J', 'S', 'N', 'A', 'P', 'S', 'H', 'T'};
+const uint32_t byte_order_mark = 0x01020304;
+
+struct snapshot_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t word_count;
+  uint64_t words_offset;
+  uint64_t string_bytes;
+  uint64_t strings_offset;
+  uint64_t reserved[2];
+};
+static_assert(sizeof(snapshot_header) == 64, "header is 64 bytes");
+
+} // namespace
+
+bool jsonparser::json_snapshot::write(const json_tape &tape,
+                                      const std::string &file_path) {
+  snapshot_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, snapshot_magic, sizeof(header.magic));
+  header.version = version;
+  header.byte_order = byte_order_mark;
+  header.word_count = tape.words.size();
+  header.words_offset = sizeof(header);
+  header.string_bytes = tape.strings.size();
+  header.strings_offset =
+      header.words_offset + header.word_count * sizeof(uint64_t);
+
+  std::ofstream ofs(file_path, std::ios::binary | std::ios::trunc);
+  ofs.write((const char *)&header, sizeof(header));
+  ofs.write((const char *)tape.words.data(),
+            tape.words.size() * sizeof(uint64_t));
+  ofs.write(tape.strings.data(), tape.strings.size());
+  ofs.close();
+  return !ofs.fail();
+}
+
+bool jsonparser::json_snapshot::detect(const std::string &file_path) {
+  // Peeking would eat the first bytes of a pipe.
+  std::error_code ec;
+  if (!std::filesystem::is_regular_file(file_path, ec))
+    return false;
+  std::ifstream ifs(file_path, std::ios::binary);
+  char magic[sizeof(snapshot_magic)];
+  return ifs.read(magic, sizeof(magic)) &&
+         !memcmp(magic, snapshot_magic, sizeof(magic));
+}
+
+jsonparser::json_snapshot::json_snapshot(const std::string &file_path) {
+  const char *base = nullptr;
+  size_t size = 0;
+
+#ifdef CONFIG_MMAP
+  int fd = open(file_path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("file not found!");
+  struct stat st;
+  if (!fstat(fd, &st) && S_ISREG(st.st_mode) &&
+      (size_t)st.st_size >= sizeof(snapshot_header)) {
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      mapping = addr;
+      mapping_size = size = st.st_size;
+      base = (const char *)addr;
+    }
+  }
+  close(fd);
+#endif
+
+  if (!base) {
+    std::ifstream ifs(file_path, std::ios::binary);
+    if (!ifs)
+      throw std::runtime_error("file not found!");
+    ifs.seekg(0, std::ios::end);
+    long long end = ifs.tellg();
+    if (end < 0)
+      throw std::runtime_error("not a snapshot!");
+    size = (size_t)end;
+    ifs.seekg(0, std::ios::beg);
+    // In words, so the tape is aligned the way it is in a mapping.
+    owned.reset(new uint64_t[(size + 7) / 8]);
+    ifs.read((char *)owned.get(), size);
+    base = (const char *)owned.get();
+  }
+
+  try {
+    load(base, size);
+  } catch (...) {
+#ifdef CONFIG_MMAP
+    if (mapping)
+      munmap(mapping, mapping_size);
+#endif
+    throw;
+  }
+}
+
+// Check the header of the snapshot in [base, base + size) and point into it.
+void jsonparser::json_snapshot::load(const char *base, size_t size) {
+  snapshot_header header;
+  if (size < sizeof(header))
+    throw std::runtime_error("not a snapshot!");
+  memcpy(&header, base, sizeof(header));
+  if (memcmp(header.magic, snapshot_magic, sizeof(header.magic)))
+    throw std::runtime_error("not a snapshot!");
+  if (header.version != version || header.byte_order != byte_order_mark)
+    throw std::runtime_error("snapshot of another version or byte order!");
+  if (header.word_count == 0 || header.words_offset % sizeof(uint64_t) ||
+      header.words_offset > size ||
+      header.word_count > (size - header.words_offset) / sizeof(uint64_t) ||
+      header.strings_offset > size ||
+      header.string_bytes > size - header.strings_offset)
+    throw std::runtime_error("truncated snapshot!");
+
+  words = (const uint64_t *)(base + header.words_offset);
+  strings = base + header.strings_offset;
+  _word_count = header.word_count;
+  _string_bytes = header.string_bytes;
+}
+
+jsonparser::json_snapshot::~json_snapshot() {
+#ifdef CONFIG_MMAP
+  if (mapping)
+    munmap(mapping, mapping_size);
+#endif
+}
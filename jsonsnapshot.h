@@ -0,0 +1,74 @@
+#ifndef JSONSNAPSHOT_H
+#define JSONSNAPSHOT_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "jsontape.h"
+
+namespace jsonparser {
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Snapshot
+///
+///===-----------------------------------------------------------------------===
+
+// A parsed document saved to disk for instant reload: its json_tape behind
+// a fixed header. Tape words refer to each other and to the string arena by
+// index and offset only, so a mapped snapshot is read in place, without a
+// pass over the nodes.
+//
+//   0   magic "JSNAPSHT"
+//   8   version, then 0x01020304 in the writer's byte order (uint32 each)
+//   16  number of tape words, offset of the words in the file (uint64 each)
+//   32  bytes of strings, offset of the strings in the file (uint64 each)
+//   48  reserved, zero
+//   64  the words, then the strings
+//
+// Loading checks the header only. A snapshot is trusted input, like a
+// library: a damaged one can make reads through it go astray.
+class json_snapshot {
+public:
+  // 2: raw numbers on the tape.
+  static constexpr uint32_t version = 2;
+
+  // Map the snapshot at file_path, or read it into memory where it can't be
+  // mapped. Throws std::runtime_error if the file can't be opened, or isn't
+  // a snapshot of this version and byte order.
+  json_snapshot(const std::string &file_path);
+  ~json_snapshot();
+
+  json_snapshot(const json_snapshot &) = delete;
+  json_snapshot &operator=(const json_snapshot &) = delete;
+
+  // The document. Valid as long as the snapshot lives.
+  json_tape_ref root() const { return json_tape_ref(words, strings, 0); }
+
+  size_t word_count() const { return _word_count; }
+  size_t string_bytes() const { return _string_bytes; }
+
+  // Save tape to file_path. Returns false if the file can't be written.
+  static bool write(const json_tape &tape, const std::string &file_path);
+
+  // Whether file_path is a regular file that starts like a snapshot.
+  static bool detect(const std::string &file_path);
+
+private:
+  const uint64_t *words = nullptr;
+  const char *strings = nullptr;
+  size_t _word_count = 0;
+  size_t _string_bytes = 0;
+
+  // Either a mapping of the whole file or a copy of it.
+  void *mapping = nullptr;
+  size_t mapping_size = 0;
+  std::unique_ptr<uint64_t[]> owned;
+
+  void load(const char *base, size_t size);
+};
+
+} // namespace jsonparser
+
+#endif
@@ -0,0 +1,157 @@
+#include "jsonsource.h"
+#include <algorithm>
+#include <climits>
+#include <filesystem>
+#include <stdexcept>
+
+#ifdef CONFIG_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef CONFIG_ZSTD
+#include <zstd.h>
+#endif
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Block Source
+///
+///===-----------------------------------------------------------------------===
+
+jsonparser::json_file_source::json_file_source(const std::string &file_path)
+    : ifs(file_path, std::ios::binary) {
+  if (!ifs)
+    throw std::runtime_error("file not found!");
+
+  // Pipes can't seek; their size stays unknown (-1).
+  ifs.seekg(0, std::ios::end);
+  _size = ifs.tellg();
+  if (_size < 0)
+    ifs.clear();
+  else
+    ifs.seekg(0, std::ios::beg);
+}
+
+long long jsonparser::json_file_source::read(char *out, long long size) {
+  if (ifs.eof())
+    return 0;
+  long long count = ifs.read(out, size).gcount();
+  if (ifs.bad())
+    return -1;
+  return count;
+}
+
+#ifdef CONFIG_ZLIB
+jsonparser::json_gzip_source::json_gzip_source(const std::string &file_path) {
+  file = gzopen(file_path.c_str(), "rb");
+  if (!file)
+    throw std::runtime_error("file not found!");
+  gzbuffer((gzFile)file, 1024 * 128);
+}
+
+jsonparser::json_gzip_source::~json_gzip_source() { gzclose((gzFile)file); }
+
+long long jsonparser::json_gzip_source::read(char *out, long long size) {
+  long long count = 0;
+  while (count < size) {
+    unsigned want = (unsigned)std::min<long long>(size - count, INT_MAX);
+    int n = gzread((gzFile)file, out + count, want);
+    if (n < 0)
+      return -1;
+    if (n == 0) {
+      // A stream cut short is corrupt input, not its end.
+      int error;
+      gzerror((gzFile)file, &error);
+      if (error == Z_BUF_ERROR)
+        return -1;
+      break;
+    }
+    count += n;
+  }
+  return count;
+}
+#endif
+
+#ifdef CONFIG_ZSTD
+jsonparser::json_zstd_source::json_zstd_source(const std::string &file_path)
+    : ifs(file_path, std::ios::binary) {
+  if (!ifs)
+    throw std::runtime_error("file not found!");
+  context = ZSTD_createDCtx();
+  input_size = ZSTD_DStreamInSize();
+  input.reset(new char[input_size]);
+}
+
+jsonparser::json_zstd_source::~json_zstd_source() {
+  ZSTD_freeDCtx((ZSTD_DCtx *)context);
+}
+
+long long jsonparser::json_zstd_source::read(char *out, long long size) {
+  ZSTD_outBuffer output = {out, (size_t)size, 0};
+  while (output.pos < output.size) {
+    if (input_pos == input_end) {
+      input_pos = 0;
+      input_end = ifs.read(input.get(), input_size).gcount();
+      if (ifs.bad())
+        return -1;
+      if (input_end == 0) {
+        // A frame cut short is corrupt input, not its end.
+        if (pending)
+          return -1;
+        break;
+      }
+    }
+
+    ZSTD_inBuffer in = {input.get(), input_end, input_pos};
+    pending = ZSTD_decompressStream((ZSTD_DCtx *)context, &output, &in);
+    if (ZSTD_isError(pending))
+      return -1;
+    input_pos = in.pos;
+  }
+  return output.pos;
+}
+#endif
+
+jsonparser::json_compression
+jsonparser::json_file_compression(const std::string &file_path) {
+  // Peeking would eat the first bytes of a pipe.
+  std::error_code ec;
+  if (!std::filesystem::is_regular_file(file_path, ec))
+    return json_compression::none;
+
+  std::ifstream ifs(file_path, std::ios::binary);
+  if (!ifs)
+    throw std::runtime_error("file not found!");
+
+  unsigned char magic[4] = {0, 0, 0, 0};
+  ifs.read((char *)magic, sizeof(magic));
+  if (magic[0] == 0x1f && magic[1] == 0x8b)
+    return json_compression::gzip;
+  if (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f &&
+      magic[3] == 0xfd)
+    return json_compression::zstd;
+  return json_compression::none;
+}
+
+std::unique_ptr<jsonparser::json_block_source>
+jsonparser::json_open_source(const std::string &file_path) {
+  switch (json_file_compression(file_path)) {
+  case json_compression::gzip:
+#ifdef CONFIG_ZLIB
+    return std::make_unique<json_gzip_source>(file_path);
+#else
+    throw std::runtime_error("gzip input needs a build with zlib!");
+#endif
+
+  case json_compression::zstd:
+#ifdef CONFIG_ZSTD
+    return std::make_unique<json_zstd_source>(file_path);
+#else
+    throw std::runtime_error("zstd input needs a build with libzstd!");
+#endif
+
+  case json_compression::none:
+    break;
+  }
+  return std::make_unique<json_file_source>(file_path);
+}
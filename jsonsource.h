@@ -0,0 +1,96 @@
+#ifndef JSONSOURCE_H
+#define JSONSOURCE_H
+
+#include <fstream>
+#include <memory>
+#include <string>
+
+namespace jsonparser {
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Block Source
+///
+///===-----------------------------------------------------------------------===
+
+// Where a streaming lexer gets its blocks from. read() runs on the lexer's
+// read-ahead thread, one call at a time, so a decompressing source works
+// concurrently with lexing.
+class json_block_source {
+public:
+  virtual ~json_block_source() = default;
+
+  // Fill [out, out + size) with the next bytes of the input. Returns fewer
+  // than size bytes only at the end of the input, and -1 if the input is
+  // unreadable or corrupt.
+  virtual long long read(char *out, long long size) = 0;
+
+  // Bytes read() will deliver in all, -1 if that isn't known up front.
+  virtual long long size() const { return -1; }
+};
+
+// A file or pipe read as it is.
+class json_file_source : public json_block_source {
+  std::ifstream ifs;
+  long long _size;
+
+public:
+  // Throws std::runtime_error if the file can't be opened.
+  json_file_source(const std::string &file_path);
+
+  long long read(char *out, long long size) override;
+  long long size() const override { return _size; }
+};
+
+#ifdef CONFIG_ZLIB
+// A gzip file, or several concatenated, inflated as it is read.
+class json_gzip_source : public json_block_source {
+  void *file; // gzFile
+
+public:
+  json_gzip_source(const std::string &file_path);
+  ~json_gzip_source();
+
+  long long read(char *out, long long size) override;
+};
+#endif
+
+#ifdef CONFIG_ZSTD
+// A zstd file, one or more frames, decompressed as it is read.
+class json_zstd_source : public json_block_source {
+  std::ifstream ifs;
+  void *context; // ZSTD_DCtx
+  std::unique_ptr<char[]> input;
+  size_t input_size;
+  size_t input_pos = 0;
+  size_t input_end = 0;
+  size_t pending = 0; // nonzero while a frame is incomplete
+
+public:
+  json_zstd_source(const std::string &file_path);
+  ~json_zstd_source();
+
+  long long read(char *out, long long size) override;
+};
+#endif
+
+typedef enum class _json_compression {
+  none,
+  gzip,
+  zstd,
+} json_compression;
+
+// Compression of the file, told by its first bytes rather than its name.
+// Anything but a regular file counts as uncompressed. Throws
+// std::runtime_error if the file can't be opened.
+json_compression json_file_compression(const std::string &file_path);
+
+// Source for the file: decompressing if it is compressed. Throws
+// std::runtime_error if the file can't be opened, or if it is compressed
+// with a format this build can't read.
+std::unique_ptr<json_block_source>
+json_open_source(const std::string &file_path);
+
+} // namespace jsonparser
+
+#endif
@@ -0,0 +1,158 @@
+#include "jsontape.h"
+#include <memory.h>
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Tape
+///
+///===-----------------------------------------------------------------------===
+
+std::string_view jsonparser::json_tape_ref::get_string() const {
+  const char *str = strings + payload();
+  uint32_t len;
+  memcpy(&len, str, sizeof(len));
+  return std::string_view(str + sizeof(len), len);
+}
+
+double jsonparser::json_tape_ref::get_double() const {
+  switch (type()) {
+  case json_tape_type::int64:
+    return (double)(int64_t)tape[index + 1];
+  case json_tape_type::uint64:
+    return (double)tape[index + 1];
+  default: {
+    double d;
+    memcpy(&d, &tape[index + 1], sizeof(d));
+    return d;
+  }
+  }
+}
+
+size_t jsonparser::json_tape_ref::next() const {
+  switch (type()) {
+  case json_tape_type::object_starts:
+  case json_tape_type::array_starts:
+    return payload() & 0xffffffff;
+  case json_tape_type::int64:
+  case json_tape_type::uint64:
+  case json_tape_type::real:
+  case json_tape_type::raw_number:
+    return index + 2;
+  default:
+    return index + 1;
+  }
+}
+
+jsonparser::json_tape_range<jsonparser::json_tape_element_iterator>
+jsonparser::json_tape_ref::elements() const {
+  // The close word terminates the iteration.
+  return {json_tape_ref(tape, strings, index + 1),
+          json_tape_ref(tape, strings, next() - 1)};
+}
+
+jsonparser::json_tape_range<jsonparser::json_tape_member_iterator>
+jsonparser::json_tape_ref::members() const {
+  return {json_tape_ref(tape, strings, index + 1),
+          json_tape_ref(tape, strings, next() - 1)};
+}
+
+jsonparser::json_tape_ref
+jsonparser::json_tape_ref::find(std::string_view key) const {
+  if (is_object())
+    for (auto member : members())
+      if (member.key == key)
+        return member.value;
+  return json_tape_ref(nullptr, nullptr, 0);
+}
+
+jsonparser::json_tape_ref jsonparser::json_tape_ref::at(size_t i) const {
+  if (is_array())
+    for (auto element : elements())
+      if (i-- == 0)
+        return element;
+  return json_tape_ref(nullptr, nullptr, 0);
+}
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Tape Builder
+///
+///===-----------------------------------------------------------------------===
+
+jsonparser::json_tape_builder::json_tape_builder(json_tape &tape)
+    : tape(tape) {
+  frames.reserve(64);
+}
+
+// Objects count their keys, arrays their values.
+void jsonparser::json_tape_builder::count_value(bool key) {
+  if (!frames.empty() && frames.back().object == key)
+    frames.back().count++;
+}
+
+void jsonparser::json_tape_builder::open(json_tape_type type, bool object) {
+  count_value();
+  frames.push_back({tape.words.size(), 0, object});
+  append(type, 0);
+}
+
+bool jsonparser::json_tape_builder::close(json_tape_type type) {
+  frame f = frames.back();
+  frames.pop_back();
+
+  // The index past the close word has 32 bits.
+  if (tape.words.size() + 1 > UINT32_MAX)
+    return false;
+
+  uint64_t count = f.count < 0xffffff ? f.count : 0xffffff;
+  tape.words[f.open] |= count << 32 | (tape.words.size() + 1);
+  append(type, f.open);
+  return true;
+}
+
+bool jsonparser::json_tape_builder::string(json_tape_type type,
+                                           std::string_view str) {
+  if (str.size() > UINT32_MAX)
+    return false;
+
+  append(type, tape.strings.size());
+  uint32_t len = (uint32_t)str.size();
+  tape.strings.insert(tape.strings.end(), (const char *)&len,
+                      (const char *)&len + sizeof(len));
+  tape.strings.insert(tape.strings.end(), str.begin(), str.end());
+  tape.strings.push_back(0);
+  return true;
+}
+
+bool jsonparser::json_tape_builder::on_number(const json_number &num,
+                                              std::string_view text) {
+  count_value();
+
+  if (!num.exact()) {
+    // Beyond 64 bits or out of double range: the text, then the double.
+    if (!string(json_tape_type::raw_number, text))
+      return false;
+    uint64_t bits;
+    memcpy(&bits, &num.d, sizeof(num.d));
+    tape.words.push_back(bits);
+    return true;
+  }
+
+  switch (num.type) {
+  case json_number_type::int64:
+    append(json_tape_type::int64, 0);
+    tape.words.push_back((uint64_t)num.i);
+    break;
+  case json_number_type::uint64:
+    append(json_tape_type::uint64, 0);
+    tape.words.push_back(num.u);
+    break;
+  default: {
+    uint64_t bits;
+    memcpy(&bits, &num.d, sizeof(num.d));
+    append(json_tape_type::real, 0);
+    tape.words.push_back(bits);
+  } break;
+  }
+  return true;
+}
@@ -0,0 +1,245 @@
+#ifndef JSONTAPE_H
+#define JSONTAPE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "jsonparser.h"
+#include "jsonsax.h"
+
+namespace jsonparser {
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Tape
+///
+///===-----------------------------------------------------------------------===
+
+// A document flattened into one array of 64-bit words in document order, and
+// one arena holding every string. The top byte of a word is its type, the low
+// 56 bits its payload:
+//
+//   '{' '['   low 32 bits: index one past the matching close word,
+//             next 24 bits: number of members/elements (saturated)
+//   '}' ']'   index of the matching open word
+//   '"'       offset of the string in the arena: a 32-bit length, the bytes
+//             and a terminating NUL
+//   'l' 'u'   int64/uint64, the value is in the following word
+//   'd'       double, its bits are in the following word
+//   'r'       number no double or 64-bit integer holds exactly, see
+//             json_number::exact(): its source text in the arena, laid out
+//             as a string, and the bits of its nearest double in the
+//             following word
+//   't' 'f' 'n'
+//
+// Object members are stored as a key string followed by its value. Nothing on
+// the tape is a pointer, so it can be copied or mapped anywhere. A tape holds
+// fewer than 2^32 words and strings shorter than 4 GiB.
+
+typedef enum class _json_tape_type : char {
+  object_starts = '{',
+  object_ends = '}',
+  array_starts = '[',
+  array_ends = ']',
+  string = '"',
+  int64 = 'l',
+  uint64 = 'u',
+  real = 'd',
+  raw_number = 'r',
+  v_true = 't',
+  v_false = 'f',
+  v_null = 'n',
+} json_tape_type;
+
+class json_tape_member;
+class json_tape_element_iterator;
+class json_tape_member_iterator;
+template <typename iterator> class json_tape_range;
+
+// Read-only view of one value on a tape.
+class json_tape_ref {
+  const uint64_t *tape;
+  const char *strings;
+  size_t index;
+
+  uint64_t payload() const { return tape[index] & 0x00ffffffffffffffULL; }
+
+public:
+  json_tape_ref(const uint64_t *tape, const char *strings, size_t index)
+      : tape(tape), strings(strings), index(index) {}
+
+  json_tape_type type() const { return (json_tape_type)(tape[index] >> 56); }
+  size_t position() const { return index; }
+
+  bool is_object() const { return type() == json_tape_type::object_starts; }
+  bool is_array() const { return type() == json_tape_type::array_starts; }
+  bool is_string() const { return type() == json_tape_type::string; }
+  bool is_int64() const { return type() == json_tape_type::int64; }
+  bool is_uint64() const { return type() == json_tape_type::uint64; }
+  bool is_double() const { return type() == json_tape_type::real; }
+  bool is_raw_number() const { return type() == json_tape_type::raw_number; }
+  bool is_numeric() const {
+    return is_int64() || is_uint64() || is_double() || is_raw_number();
+  }
+  bool is_bool() const {
+    return type() == json_tape_type::v_true || type() == json_tape_type::v_false;
+  }
+  bool is_null() const { return type() == json_tape_type::v_null; }
+
+  std::string_view get_string() const;
+  int64_t get_int64() const { return (int64_t)tape[index + 1]; }
+  uint64_t get_uint64() const { return tape[index + 1]; }
+  double get_double() const;
+  // Source text of a raw number.
+  std::string_view get_raw_number() const { return get_string(); }
+  bool get_bool() const { return type() == json_tape_type::v_true; }
+
+  // Members of an object or elements of an array. Saturates at 2^24 - 1.
+  size_t size() const { return (payload() >> 32) & 0xffffff; }
+
+  // Index of the word following this value, skipping whole containers.
+  size_t next() const;
+
+  json_tape_range<json_tape_element_iterator> elements() const;
+  json_tape_range<json_tape_member_iterator> members() const;
+
+  // Linear lookups; an invalid ref (type 0) when absent.
+  json_tape_ref find(std::string_view key) const;
+  json_tape_ref at(size_t i) const;
+  json_tape_ref operator[](std::string_view key) const { return find(key); }
+
+  bool valid() const { return tape != nullptr; }
+
+  friend class json_tape_element_iterator;
+  friend class json_tape_member_iterator;
+  friend class json_writer;
+};
+
+class json_tape_member {
+public:
+  std::string_view key;
+  json_tape_ref value;
+};
+
+// Iteration over the elements of an array.
+class json_tape_element_iterator {
+  json_tape_ref cur;
+
+public:
+  json_tape_element_iterator(json_tape_ref cur) : cur(cur) {}
+  json_tape_ref operator*() const { return cur; }
+  json_tape_element_iterator &operator++() {
+    cur.index = cur.next();
+    return *this;
+  }
+  bool operator!=(const json_tape_element_iterator &other) const {
+    return cur.index != other.cur.index;
+  }
+};
+
+// Iteration over the key/value pairs of an object.
+class json_tape_member_iterator {
+  json_tape_ref cur;
+
+public:
+  json_tape_member_iterator(json_tape_ref cur) : cur(cur) {}
+  json_tape_member operator*() const {
+    return {cur.get_string(), json_tape_ref(cur.tape, cur.strings, cur.index + 1)};
+  }
+  json_tape_member_iterator &operator++() {
+    cur.index = json_tape_ref(cur.tape, cur.strings, cur.index + 1).next();
+    return *this;
+  }
+  bool operator!=(const json_tape_member_iterator &other) const {
+    return cur.index != other.cur.index;
+  }
+};
+
+template <typename iterator> class json_tape_range {
+  iterator b, e;
+
+public:
+  json_tape_range(iterator b, iterator e) : b(b), e(e) {}
+  iterator begin() const { return b; }
+  iterator end() const { return e; }
+};
+
+class json_tape {
+public:
+  std::vector<uint64_t> words;
+  std::vector<char> strings;
+
+  json_tape_ref root() const {
+    return json_tape_ref(words.data(), strings.data(), 0);
+  }
+
+  void clear() {
+    words.clear();
+    strings.clear();
+  }
+
+  // Bytes held by the tape and the string arena.
+  size_t memory() const {
+    return words.capacity() * sizeof(uint64_t) + strings.capacity();
+  }
+};
+
+// Appends the events of json_parser::parse(json_tape &) to a tape. An event
+// that would overflow a field of the tape stops the parse.
+class json_tape_builder : public json_handler {
+  json_tape &tape;
+
+  struct frame {
+    size_t open;
+    size_t count;
+    bool object;
+  };
+  std::vector<frame> frames;
+
+  void append(json_tape_type type, uint64_t payload) {
+    tape.words.push_back((uint64_t)type << 56 | payload);
+  }
+  void open(json_tape_type type, bool object);
+  bool close(json_tape_type type);
+  void count_value(bool key = false);
+  bool string(json_tape_type type, std::string_view str);
+
+public:
+  json_tape_builder(json_tape &tape);
+
+  bool on_start_object() {
+    open(json_tape_type::object_starts, true);
+    return true;
+  }
+  bool on_end_object() { return close(json_tape_type::object_ends); }
+  bool on_start_array() {
+    open(json_tape_type::array_starts, false);
+    return true;
+  }
+  bool on_end_array() { return close(json_tape_type::array_ends); }
+  bool on_key(std::string_view key) {
+    count_value(true);
+    return string(json_tape_type::string, key);
+  }
+  bool on_string(std::string_view str) {
+    count_value();
+    return string(json_tape_type::string, str);
+  }
+  bool on_number(const json_number &num, std::string_view text);
+  bool on_bool(bool value) {
+    count_value();
+    append(value ? json_tape_type::v_true : json_tape_type::v_false, 0);
+    return true;
+  }
+  bool on_null() {
+    count_value();
+    append(json_tape_type::v_null, 0);
+    return true;
+  }
+};
+
+} // namespace jsonparser
+
+#endif
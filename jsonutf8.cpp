@@ -0,0 +1,304 @@
+#include "jsonutf8.h"
+#include "jsonindex.h"
+#include <cstdint>
+#include <memory.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CONFIG_UTF8_X86
+#endif
+
+///===-----------------------------------------------------------------------===
+///
+///               Scalar Validation
+///
+///===-----------------------------------------------------------------------===
+
+// Length of the sequence at p if it is valid UTF-8. Otherwise the negated
+// length of its maximal subpart: the longest prefix any valid sequence
+// starts with, or the lead byte alone.
+static int utf8_sequence(const unsigned char *p, const unsigned char *end) {
+  unsigned c = p[0];
+  if (c < 0x80)
+    return 1;
+
+  // Range of the second byte; the others are plain continuation bytes.
+  int length;
+  unsigned low = 0x80, high = 0xbf;
+  if (c >= 0xc2 && c <= 0xdf) {
+    length = 2;
+  } else if (c >= 0xe0 && c <= 0xef) {
+    length = 3;
+    if (c == 0xe0)
+      low = 0xa0; // overlong
+    else if (c == 0xed)
+      high = 0x9f; // surrogates
+  } else if (c >= 0xf0 && c <= 0xf4) {
+    length = 4;
+    if (c == 0xf0)
+      low = 0x90; // overlong
+    else if (c == 0xf4)
+      high = 0x8f; // past U+10FFFF
+  } else {
+    return -1;
+  }
+
+  for (int i = 1; i < length; i++) {
+    if (p + i == end || p[i] < low || p[i] > high)
+      return -i;
+    low = 0x80;
+    high = 0xbf;
+  }
+  return length;
+}
+
+static size_t validate_scalar(const unsigned char *data, size_t size,
+                              size_t at) {
+  const uint64_t high_bits = 0x8080808080808080ULL;
+  while (at < size) {
+    if (size - at >= 8) {
+      uint64_t word;
+      memcpy(&word, data + at, 8);
+      if (!(word & high_bits)) {
+        at += 8;
+        continue;
+      }
+    }
+    int length = utf8_sequence(data + at, data + size);
+    if (length < 0)
+      return at;
+    at += length;
+  }
+  return size;
+}
+
+#ifdef CONFIG_UTF8_X86
+///===-----------------------------------------------------------------------===
+///
+///               Vector Validation
+///
+///===-----------------------------------------------------------------------===
+
+// The vector kernels only tell the block an error shows in. Everything
+// before at was checked, except a sequence the block boundary may have cut:
+// back up to its lead byte and find the error byte by byte from there.
+static size_t locate_error(const unsigned char *data, size_t size,
+                           size_t at) {
+  size_t from = at > 3 ? at - 3 : 0;
+  while (from > 0 && (data[from] & 0xc0) == 0x80)
+    from--;
+  return validate_scalar(data, size, from);
+}
+
+// Keiser and Lemire's lookup algorithm. Every pair of adjacent bytes is
+// classified by three 16 entry tables, on the high nibble of the first byte,
+// its low nibble and the high nibble of the second; a bit set in all three
+// marks one kind of error. Third and fourth bytes of a sequence are matched
+// against the lead bytes two and three positions back.
+enum : uint8_t {
+  too_short = 1 << 0,      // lead byte, then no continuation
+  too_long = 1 << 1,       // continuation after ASCII
+  overlong_3 = 1 << 2,     // e0 80..9f
+  too_large = 1 << 3,      // f4 90..bf, f5..ff 90..bf
+  surrogate = 1 << 4,      // ed a0..bf
+  overlong_2 = 1 << 5,     // c0..c1 any continuation
+  too_large_1000 = 1 << 6, // f5..ff 80..8f
+  overlong_4 = 1 << 6,     // f0 80..8f
+  two_conts = 1 << 7,      // continuation after continuation
+  carry = too_short | too_long | two_conts,
+};
+
+alignas(16) static const uint8_t byte_1_high[16] = {
+    too_long,  too_long,  too_long,  too_long,
+    too_long,  too_long,  too_long,  too_long,
+    two_conts, two_conts, two_conts, two_conts,
+    too_short | overlong_2,
+    too_short,
+    too_short | overlong_3 | surrogate,
+    too_short | too_large | too_large_1000 | overlong_4,
+};
+
+alignas(16) static const uint8_t byte_1_low[16] = {
+    carry | overlong_3 | overlong_2 | overlong_4,
+    carry | overlong_2,
+    carry,
+    carry,
+    carry | too_large,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000 | surrogate,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+};
+
+alignas(16) static const uint8_t byte_2_high[16] = {
+    too_short, too_short, too_short, too_short,
+    too_short, too_short, too_short, too_short,
+    too_long | overlong_2 | two_conts | overlong_3 | too_large_1000 |
+        overlong_4,
+    too_long | overlong_2 | two_conts | overlong_3 | too_large,
+    too_long | overlong_2 | two_conts | surrogate | too_large,
+    too_long | overlong_2 | two_conts | surrogate | too_large,
+    too_short, too_short, too_short, too_short,
+};
+
+// Non-zero bytes where the pairs ending in block went wrong; prev is the
+// block before it.
+__attribute__((target("sse4.2"))) static inline __m128i
+check_sse42(__m128i block, __m128i prev) {
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  const __m128i b1h = _mm_load_si128((const __m128i *)byte_1_high);
+  const __m128i b1l = _mm_load_si128((const __m128i *)byte_1_low);
+  const __m128i b2h = _mm_load_si128((const __m128i *)byte_2_high);
+
+  __m128i prev1 = _mm_alignr_epi8(block, prev, 15);
+  __m128i special = _mm_and_si128(
+      _mm_and_si128(
+          _mm_shuffle_epi8(b1h,
+                           _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+          _mm_shuffle_epi8(b1l, _mm_and_si128(prev1, nibble))),
+      _mm_shuffle_epi8(b2h, _mm_and_si128(_mm_srli_epi16(block, 4), nibble)));
+
+  // Only e0..ff two back and f0..ff three back leave the high bit set.
+  __m128i prev2 = _mm_alignr_epi8(block, prev, 14);
+  __m128i prev3 = _mm_alignr_epi8(block, prev, 13);
+  __m128i must_continue =
+      _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(0xe0 - 0x80)),
+                   _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xf0 - 0x80))));
+  must_continue = _mm_and_si128(must_continue, _mm_set1_epi8((char)0x80));
+  return _mm_xor_si128(must_continue, special);
+}
+
+__attribute__((target("sse4.2"))) static size_t
+validate_sse42(const unsigned char *data, size_t size) {
+  __m128i prev = _mm_setzero_si128();
+  bool prev_ascii = true;
+  size_t at = 0;
+  for (; at + 16 <= size; at += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(data + at));
+    bool ascii = !_mm_movemask_epi8(block);
+    // An ASCII block still ends a sequence the previous one may have cut.
+    if (!ascii || !prev_ascii) {
+      __m128i error = check_sse42(block, prev);
+      if (!_mm_testz_si128(error, error))
+        return locate_error(data, size, at);
+    }
+    prev = block;
+    prev_ascii = ascii;
+  }
+
+  // The rest padded with zeros, which cut any sequence left open.
+  if (at < size || !prev_ascii) {
+    alignas(16) unsigned char last[16] = {0};
+    memcpy(last, data + at, size - at);
+    __m128i error = check_sse42(_mm_load_si128((const __m128i *)last), prev);
+    if (!_mm_testz_si128(error, error))
+      return locate_error(data, size, at);
+  }
+  return size;
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+check_avx2(__m256i block, __m256i prev) {
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  const __m256i b1h =
+      _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)byte_1_high));
+  const __m256i b1l =
+      _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)byte_1_low));
+  const __m256i b2h =
+      _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)byte_2_high));
+
+  // alignr works within 128 bit lanes: line up the previous bytes first.
+  __m256i shifted = _mm256_permute2x128_si256(prev, block, 0x21);
+  __m256i prev1 = _mm256_alignr_epi8(block, shifted, 15);
+  __m256i special = _mm256_and_si256(
+      _mm256_and_si256(
+          _mm256_shuffle_epi8(
+              b1h, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+          _mm256_shuffle_epi8(b1l, _mm256_and_si256(prev1, nibble))),
+      _mm256_shuffle_epi8(
+          b2h, _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble)));
+
+  __m256i prev2 = _mm256_alignr_epi8(block, shifted, 14);
+  __m256i prev3 = _mm256_alignr_epi8(block, shifted, 13);
+  __m256i must_continue = _mm256_or_si256(
+      _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xe0 - 0x80)),
+      _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xf0 - 0x80))));
+  must_continue =
+      _mm256_and_si256(must_continue, _mm256_set1_epi8((char)0x80));
+  return _mm256_xor_si256(must_continue, special);
+}
+
+__attribute__((target("avx2"))) static size_t
+validate_avx2(const unsigned char *data, size_t size) {
+  __m256i prev = _mm256_setzero_si256();
+  bool prev_ascii = true;
+  size_t at = 0;
+  for (; at + 32 <= size; at += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(data + at));
+    bool ascii = !_mm256_movemask_epi8(block);
+    if (!ascii || !prev_ascii) {
+      __m256i error = check_avx2(block, prev);
+      if (!_mm256_testz_si256(error, error))
+        return locate_error(data, size, at);
+    }
+    prev = block;
+    prev_ascii = ascii;
+  }
+
+  if (at < size || !prev_ascii) {
+    alignas(32) unsigned char last[32] = {0};
+    memcpy(last, data + at, size - at);
+    __m256i error =
+        check_avx2(_mm256_load_si256((const __m256i *)last), prev);
+    if (!_mm256_testz_si256(error, error))
+      return locate_error(data, size, at);
+  }
+  return size;
+}
+#endif
+
+///===-----------------------------------------------------------------------===
+///
+///               Json UTF-8
+///
+///===-----------------------------------------------------------------------===
+
+size_t jsonparser::json_utf8_validate(const char *data, size_t size) {
+  const unsigned char *bytes = (const unsigned char *)data;
+  // Short strings, most keys among them, aren't worth a vector setup.
+  if (size < 16)
+    return validate_scalar(bytes, size, 0);
+
+#ifdef CONFIG_UTF8_X86
+  switch (json_structural_index::active()) {
+  case json_structural_index::isa::avx2:
+    return validate_avx2(bytes, size);
+  case json_structural_index::isa::sse42:
+    return validate_sse42(bytes, size);
+  default:
+    break;
+  }
+#endif
+  return validate_scalar(bytes, size, 0);
+}
+
+void jsonparser::json_utf8_replace(const char *data, size_t size,
+                                   std::string &out) {
+  const unsigned char *bytes = (const unsigned char *)data;
+  size_t at = 0;
+  while (true) {
+    size_t valid = at + json_utf8_validate(data + at, size - at);
+    out.append(data + at, valid - at);
+    if (valid == size)
+      return;
+    out += "\xef\xbf\xbd";
+    at = valid - utf8_sequence(bytes + valid, bytes + size);
+  }
+}
@@ -0,0 +1,36 @@
+#ifndef JSONUTF8_H
+#define JSONUTF8_H
+
+#include <cstddef>
+#include <string>
+
+namespace jsonparser {
+
+///===-----------------------------------------------------------------------===
+///
+///               Json UTF-8
+///
+///===-----------------------------------------------------------------------===
+
+// What the lexer does with a string that isn't valid UTF-8: overlong forms,
+// surrogates, code points past U+10FFFF, stray continuation bytes and cut
+// sequences.
+typedef enum class _json_utf8_mode {
+  reject,  // the string is a lexing error, at its first invalid byte
+  replace, // each invalid sequence reads as U+FFFD
+  accept,  // strings are not checked, their bytes are taken as they are
+} json_utf8_mode;
+
+// Length of the longest valid UTF-8 prefix of [data, data + size): size if
+// all of it is valid. Blocks of 16 or 32 bytes are checked at a time with
+// the instruction set of json_structural_index::active(); ASCII blocks cost
+// a compare each.
+size_t json_utf8_validate(const char *data, size_t size);
+
+// Append [data, data + size) to out with every maximal invalid subsequence
+// replaced by U+FFFD, as the Unicode standard recommends.
+void json_utf8_replace(const char *data, size_t size, std::string &out);
+
+} // namespace jsonparser
+
+#endif
@@ -0,0 +1,360 @@
+#include "jsonwriter.h"
+#include "jsontape.h"
+#include <algorithm>
+#include <errno.h>
+#include <memory.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Writer
+///
+///===-----------------------------------------------------------------------===
+
+static inline bool needs_escape(unsigned char c) {
+  return c < 0x20 || c == '"' || c == '\\';
+}
+
+// First byte in [p, end) that must be escaped, or end.
+static const char *escape_free(const char *p, const char *end) {
+#if defined(__SSE2__)
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control = _mm_set1_epi8(0x1f);
+  for (; end - p >= 16; p += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    // Unsigned v <= 0x1f exactly when max(v, 0x1f) is 0x1f.
+    __m128i hit = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+        _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+    int mask = _mm_movemask_epi8(hit);
+    if (mask)
+      return p + __builtin_ctz(mask);
+  }
+#endif
+  while (p != end && !needs_escape(*p))
+    p++;
+  return p;
+}
+
+jsonparser::json_writer::json_writer(int fd, bool format)
+    : sink(sink_kind::fd), fd(fd), format(format), buffer(&own) {}
+
+jsonparser::json_writer::json_writer(std::ostream &os, bool format)
+    : sink(sink_kind::stream), os(&os), format(format), buffer(&own) {}
+
+jsonparser::json_writer::json_writer(std::string &out, bool format)
+    : sink(sink_kind::string), format(format), buffer(&out),
+      used(out.size()) {}
+
+jsonparser::json_writer::~json_writer() { flush(); }
+
+bool jsonparser::json_writer::flush() {
+  switch (sink) {
+  case sink_kind::fd: {
+    const char *p = buffer->data();
+    size_t left = used;
+    while (left && !failed) {
+#if defined(_WIN32)
+      long n = _write(fd, p, (unsigned)std::min<size_t>(left, 1u << 30));
+#else
+      long n = ::write(fd, p, left);
+#endif
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        failed = true;
+      else {
+        p += n;
+        left -= n;
+      }
+    }
+    used = 0;
+  } break;
+
+  case sink_kind::stream:
+    if (used && !failed && !os->write(buffer->data(), used))
+      failed = true;
+    used = 0;
+    break;
+
+  case sink_kind::string:
+    buffer->resize(used);
+    break;
+  }
+  return !failed;
+}
+
+// Room for size more bytes at the end of the buffer. Block sinks are handed
+// the buffer once it holds block_size bytes; a string just grows.
+char *jsonparser::json_writer::reserve(size_t size) {
+  if (used + size > buffer->size()) {
+    if (sink != sink_kind::string && used && used + size > block_size)
+      flush();
+    if (used + size > buffer->size()) {
+      size_t grown = std::max(buffer->size() * 2, used + size);
+      if (sink != sink_kind::string)
+        grown = std::max(std::min(grown, block_size), used + size);
+      buffer->resize(std::max<size_t>(grown, 256));
+    }
+  }
+  return &(*buffer)[used];
+}
+
+void jsonparser::json_writer::raw(std::string_view text) {
+  // In blocks, so a long text doesn't grow the buffer past block_size.
+  while (!text.empty()) {
+    size_t n = std::min(text.size(), block_size);
+    memcpy(reserve(n), text.data(), n);
+    used += n;
+    text.remove_prefix(n);
+  }
+}
+
+void jsonparser::json_writer::string(std::string_view str) {
+  static const char hex[] = "0123456789abcdef";
+  const char *p = str.data(), *end = p + str.size();
+
+  put('"');
+  while (true) {
+    const char *stop = escape_free(p, end);
+    raw(std::string_view(p, stop - p));
+    if (stop == end)
+      break;
+
+    char *out = reserve(6);
+    unsigned char c = *stop;
+    char short_form = 0;
+    switch (c) {
+    case '"':
+      short_form = '"';
+      break;
+    case '\\':
+      short_form = '\\';
+      break;
+    case '\b':
+      short_form = 'b';
+      break;
+    case '\f':
+      short_form = 'f';
+      break;
+    case '\n':
+      short_form = 'n';
+      break;
+    case '\r':
+      short_form = 'r';
+      break;
+    case '\t':
+      short_form = 't';
+      break;
+    }
+    out[0] = '\\';
+    if (short_form) {
+      out[1] = short_form;
+      used += 2;
+    } else {
+      memcpy(out + 1, "u00", 3);
+      out[4] = hex[c >> 4];
+      out[5] = hex[c & 15];
+      used += 6;
+    }
+    p = stop + 1;
+  }
+  put('"');
+}
+
+void jsonparser::json_writer::newline(size_t level) {
+  if (spaces.size() < level * 2)
+    spaces.assign(std::max(level * 2, spaces.size() * 2), ' ');
+  put('\n');
+  raw(std::string_view(spaces.data(), level * 2));
+}
+
+void jsonparser::json_writer::scalar(const json_value &value) {
+  if (value.is_string()) {
+    string(static_cast<const json_string &>(value).str);
+  } else if (value.is_numeric()) {
+    auto &num = static_cast<const json_numeric &>(value);
+    if (!num.numstr.empty()) {
+      raw(num.numstr);
+    } else {
+      char *out = reserve(json_number_chars);
+      used += json_format_number(num.value, out) - out;
+    }
+  } else {
+    switch (static_cast<const json_state &>(value).type) {
+    case json_token::v_true:
+      raw("true");
+      break;
+    case json_token::v_false:
+      raw("false");
+      break;
+    default:
+      raw("null");
+      break;
+    }
+  }
+}
+
+bool jsonparser::json_writer::write(const json_value &value, size_t level) {
+  frames.clear();
+  const json_value *node = &value;
+
+  while (node) {
+    if (node->is_object() &&
+        !static_cast<const json_object *>(node)->keyvalue.empty()) {
+      put('{');
+      frames.push_back({node, 0});
+    } else if (node->is_array() &&
+               !static_cast<const json_array *>(node)->array.empty()) {
+      put('[');
+      frames.push_back({node, 0});
+    } else if (node->is_object()) {
+      raw("{}");
+    } else if (node->is_array()) {
+      raw("[]");
+    } else {
+      scalar(*node);
+    }
+
+    // Up to the innermost container with something left, and its next
+    // member or element.
+    node = nullptr;
+    while (!frames.empty() && !node) {
+      frame &f = frames.back();
+      size_t depth = level + frames.size();
+
+      if (f.node->is_object()) {
+        auto &members = static_cast<const json_object *>(f.node)->keyvalue;
+        if (f.next < members.size()) {
+          if (f.next)
+            put(',');
+          if (format)
+            newline(depth);
+          string(members[f.next].first.str());
+          if (format)
+            raw(": ");
+          else
+            put(':');
+          node = &*members[f.next++].second;
+          continue;
+        }
+      } else {
+        auto &elements = static_cast<const json_array *>(f.node)->array;
+        if (f.next < elements.size()) {
+          if (f.next)
+            put(',');
+          if (format)
+            newline(depth);
+          node = &*elements[f.next++];
+          continue;
+        }
+      }
+
+      if (format)
+        newline(depth - 1);
+      put(f.node->is_object() ? '}' : ']');
+      frames.pop_back();
+    }
+  }
+  return !failed;
+}
+
+// The tape holds the document in order, so it is written front to back;
+// only commas and indentation need the enclosing containers.
+bool jsonparser::json_writer::write(const json_tape_ref &value, size_t level) {
+  tape_frames.clear();
+  const uint64_t *tape = value.tape;
+  size_t i = value.index, end = value.next();
+  bool after_key = false;
+
+  while (i < end) {
+    json_tape_ref cur(tape, value.strings, i);
+    json_tape_type type = cur.type();
+
+    if (type == json_tape_type::object_ends ||
+        type == json_tape_type::array_ends) {
+      if (format && tape_frames.back().second)
+        newline(level + tape_frames.size() - 1);
+      put(type == json_tape_type::object_ends ? '}' : ']');
+      tape_frames.pop_back();
+      i++;
+      continue;
+    }
+
+    if (!tape_frames.empty() && !after_key) {
+      if (tape_frames.back().second++)
+        put(',');
+      if (format)
+        newline(level + tape_frames.size());
+      if (tape_frames.back().first) {
+        // A member starts with its key.
+        string(cur.get_string());
+        if (format)
+          raw(": ");
+        else
+          put(':');
+        after_key = true;
+        i++;
+        continue;
+      }
+    }
+    after_key = false;
+
+    switch (type) {
+    case json_tape_type::object_starts:
+    case json_tape_type::array_starts:
+      put(type == json_tape_type::object_starts ? '{' : '[');
+      tape_frames.push_back({type == json_tape_type::object_starts, 0});
+      i++;
+      break;
+    case json_tape_type::string:
+      string(cur.get_string());
+      i++;
+      break;
+    case json_tape_type::int64:
+    case json_tape_type::uint64:
+    case json_tape_type::real: {
+      json_number num;
+      if (type == json_tape_type::int64) {
+        num.i = cur.get_int64();
+      } else if (type == json_tape_type::uint64) {
+        num.type = json_number_type::uint64;
+        num.u = cur.get_uint64();
+      } else {
+        num.type = json_number_type::real;
+        num.d = cur.get_double();
+      }
+      char *out = reserve(json_number_chars);
+      used += json_format_number(num, out) - out;
+      i += 2;
+    } break;
+    case json_tape_type::raw_number:
+      raw(cur.get_raw_number());
+      i += 2;
+      break;
+    case json_tape_type::v_true:
+      raw("true");
+      i++;
+      break;
+    case json_tape_type::v_false:
+      raw("false");
+      i++;
+      break;
+    default:
+      raw("null");
+      i++;
+      break;
+    }
+  }
+  return !failed;
+}
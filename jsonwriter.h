@@ -0,0 +1,94 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "jsonparser.h"
+
+namespace jsonparser {
+
+class json_tape_ref;
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Writer
+///
+///===-----------------------------------------------------------------------===
+
+// Serializes json_value trees into an output buffer that is handed to the sink
+// in blocks of block_size bytes: a file descriptor, a stream, or a string the
+// writer appends to directly. Containers are walked with an explicit stack,
+// so nesting depth is bounded by memory only, and pretty output copies its
+// indentation from one preallocated run of spaces.
+//
+// Strings are escaped on the way out, 16 bytes at a time where SSE2 is
+// available: quotes, backslashes and control characters. Bytes >= 0x80 are
+// copied as they are.
+class json_writer {
+public:
+  static constexpr size_t block_size = 1024 * 64;
+
+  json_writer(int fd, bool format = false);
+  json_writer(std::ostream &os, bool format = false);
+  json_writer(std::string &out, bool format = false);
+  ~json_writer();
+
+  json_writer(const json_writer &) = delete;
+  json_writer &operator=(const json_writer &) = delete;
+
+  // Append value. level is the depth it sits at in an enclosing document,
+  // for the indentation of pretty output. Returns false once the sink has
+  // failed.
+  bool write(const json_value &value, size_t level = 0);
+  // Same for a value on a tape or in a json_snapshot.
+  bool write(const json_tape_ref &value, size_t level = 0);
+
+  // Append text as it is, a separator between documents for instance.
+  void raw(std::string_view text);
+
+  // Append str as a quoted, escaped JSON string.
+  void string(std::string_view str);
+
+  // Hand everything buffered to the sink. Returns false once the sink has
+  // failed.
+  bool flush();
+
+private:
+  enum class sink_kind { fd, stream, string };
+  sink_kind sink;
+  int fd = -1;
+  std::ostream *os = nullptr;
+
+  bool format;
+  bool failed = false;
+
+  // [0, used) of buffer is pending. For a string sink the buffer is the
+  // target itself, trimmed to used on flush().
+  std::string own;
+  std::string *buffer;
+  size_t used = 0;
+
+  // One open container: the next member or element to write.
+  struct frame {
+    const json_value *node;
+    size_t next;
+  };
+  std::vector<frame> frames;
+  // Open containers of a tape, written front to back: object or not, and
+  // members or elements so far.
+  std::vector<std::pair<bool, size_t>> tape_frames;
+  std::string spaces;
+
+  char *reserve(size_t size);
+  void put(char c) { *reserve(1) = c; used++; }
+  void newline(size_t level);
+  void scalar(const json_value &value);
+};
+
+} // namespace jsonparser
+
+#endif
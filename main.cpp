@@ -1,28 +1,154 @@
+#include "jsonlines.h"
 #include "jsonparser.h"
+#include "jsonsnapshot.h"
+#include "jsonwriter.h"
 #include <iostream>
 #include <memory>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 
 using namespace std;
 using namespace jsonparser;
 
-int main(int argc, char *argv[]) {
+static const char usage[] =
+    " <filename> [-f] [-p <path>]... [-l | -a] [-j <threads>]"
+    " [--stats] [-s <snapshot>] [--utf8 reject|replace|accept]\n";
+
+// Report a failed parse: where the JSON is wrong, or that it couldn't be read.
+static int parse_failed(const json_parser &ps) {
+  if (ps.source_error())
+    std::cerr << "corrupt compressed input\n";
+  else
+    std::cerr << "parse error at offset " << ps.position() << '\n';
+  return 1;
+}
+
+// Files that can't be read, compressed ones whole for -l and -a too, throw
+// std::runtime_error.
+int main(int argc, char *argv[]) try {
   if (argc < 2) {
-    std::cout << argv[0] << " <filename> [-f]\n";
+    std::cout << argv[0] << usage;
     return 0;
   }
 
-  json_parser ps(argv[1]);
-  while (ps.step())
-    ;
+  bool format = false;
+  bool lines = false;
+  bool array = false;
+  bool stats = false;
+  const char *snapshot = nullptr;
+  json_utf8_mode utf8 = json_utf8_mode::reject;
+  unsigned threads = 0;
+  json_path_filter paths;
+  try {
+    for (int i = 2; i < argc; i++) {
+      if (!strcmp(argv[i], "-f"))
+        format = true;
+      else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+        paths.add(argv[++i]);
+      else if (!strcmp(argv[i], "-l"))
+        lines = true;
+      else if (!strcmp(argv[i], "-a"))
+        array = true;
+      else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+        threads = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "--stats"))
+        stats = true;
+      else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+        snapshot = argv[++i];
+      else if (!strcmp(argv[i], "--utf8") && i + 1 < argc) {
+        // Invalid UTF-8 in strings: fail, write U+FFFD, or copy it as it is.
+        const char *mode = argv[++i];
+        if (!strcmp(mode, "replace"))
+          utf8 = json_utf8_mode::replace;
+        else if (!strcmp(mode, "accept"))
+          utf8 = json_utf8_mode::accept;
+      }
+    }
+  } catch (const std::invalid_argument &e) {
+    // A malformed -p expression, or too many of them.
+    std::cerr << e.what() << '\n' << argv[0] << usage;
+    return 1;
+  }
 
-  if (argc >= 3 && !strcmp(argv[2], "-f"))
-    ps.entry()->print(std::cout, true);
-  else
-    ps.entry()->print(std::cout);
-  
-  std::cout << '\n';
+  // A snapshot given as input is printed back as JSON.
+  if (json_snapshot::detect(argv[1])) {
+    json_snapshot snap(argv[1]);
+    json_writer out(fileno(stdout), format);
+    out.write(snap.root());
+    out.raw("\n");
+    return out.flush() ? 0 : 1;
+  }
+
+  if (snapshot) {
+    // Parse onto a tape and save it.
+    json_parser ps(argv[1], 1024 * 256, json_input_mode::mapped);
+    ps.utf8() = utf8;
+    json_tape tape;
+    if (!ps.parse(tape))
+      return parse_failed(ps);
+    if (!json_snapshot::write(tape, snapshot)) {
+      std::cerr << "cannot write " << snapshot << '\n';
+      return 1;
+    }
+    return 0;
+  }
+
+  if (lines) {
+    // JSON Lines: one document per line, parsed in parallel.
+    json_lines_reader reader(argv[1], threads);
+    reader.filter(std::move(paths));
+    reader.utf8() = utf8;
+    if (!reader.parse()) {
+      std::cerr << "parse error at line " << reader.error_line() << '\n';
+      return 1;
+    }
+    json_writer out(fileno(stdout), format);
+    for (auto doc : reader.documents()) {
+      out.write(*doc);
+      out.raw("\n");
+    }
+    return out.flush() ? 0 : 1;
+  }
+
+  // Array indices change across the pieces, so a filter parses serially.
+  if (array && paths.empty()) {
+    // One big array, its elements parsed in parallel.
+    json_array_reader reader(argv[1], threads);
+    reader.utf8() = utf8;
+    if (!reader.parse()) {
+      std::cerr << "parse error at offset " << reader.error_position() << '\n';
+      return 1;
+    }
+    json_writer out(fileno(stdout), format);
+    out.write(*reader.entry());
+    out.raw("\n");
+    return out.flush() ? 0 : 1;
+  }
+
+  json_parser ps(argv[1], 1024 * 256, json_input_mode::mapped);
+  ps.filter(std::move(paths));
+  ps.utf8() = utf8;
+  bool ok = ps.parse();
+  if (stats) {
+    // Serial parses only; the readers above run a parser per piece.
+#ifdef CONFIG_STATS
+    ps.stats().print(std::cerr);
+#else
+    std::cerr << "statistics need a build with CONFIG_STATS\n";
+#endif
+  }
+  if (!ok)
+    return parse_failed(ps);
+
+  json_writer out(fileno(stdout), format);
+  out.write(*ps.entry());
+  out.raw("\n");
 
-  return 0;
+  return out.flush() ? 0 : 1;
+} catch (const std::runtime_error &e) {
+  std::cerr << e.what() << '\n';
+  return 1;
 }
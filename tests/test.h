@@ -0,0 +1,58 @@
+#ifndef JSONPARSER_TEST_H
+#define JSONPARSER_TEST_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+///===-----------------------------------------------------------------------===
+///
+///               Tests
+///
+///===-----------------------------------------------------------------------===
+
+// Regression tests, all in one executable. TEST(group, name) registers a
+// test; `jsonparser_test group...` runs the groups given, or all of them, and
+// exits non-zero if a CHECK failed. Each group is a ctest test.
+
+struct test_case {
+  const char *group;
+  const char *name;
+  void (*run)();
+};
+
+std::vector<test_case> &test_cases();
+
+// Count a failed check and report it, with detail if any.
+void test_failed(const char *file, int line, const char *what,
+                 const std::string &detail = {});
+
+// Contents of a file of the source tree, such as example1.json.
+std::string test_file(const char *name);
+
+struct test_registrar {
+  test_registrar(const char *group, const char *name, void (*run)()) {
+    test_cases().push_back({group, name, run});
+  }
+};
+
+#define TEST(group, name)                                                      \
+  static void test_##group##_##name();                                         \
+  static test_registrar registrar_##group##_##name(#group, #name,              \
+                                                   test_##group##_##name);     \
+  static void test_##group##_##name()
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond))                                                               \
+      test_failed(__FILE__, __LINE__, #cond);                                  \
+  } while (0)
+
+// Same, saying which input failed.
+#define CHECK_FOR(cond, input)                                                 \
+  do {                                                                         \
+    if (!(cond))                                                               \
+      test_failed(__FILE__, __LINE__, #cond, input);                           \
+  } while (0)
+
+#endif
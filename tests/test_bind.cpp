@@ -0,0 +1,44 @@
+#include "jsonbind.h"
+#include "jsonparser.h"
+#include "test.h"
+
+using namespace jsonparser;
+
+///===-----------------------------------------------------------------------===
+///
+///               Typed Reading
+///
+///===-----------------------------------------------------------------------===
+
+struct point {
+  long long x;
+  double y;
+  std::string name;
+};
+JSON_FIELDS(point, x, y, name)
+
+TEST(bind, document) {
+  json_parser ps(R"([{"x":1,"y":2.5,"name":"a"},{"name":"b","z":[],"x":-3}])",
+                 json_buffer_mode::borrow);
+  std::vector<point> points;
+  CHECK(ps.parse_into(points));
+  CHECK(points.size() == 2);
+  CHECK(points.size() == 2 && points[0].x == 1 && points[0].y == 2.5 &&
+        points[0].name == "a" && points[1].x == -3 && points[1].name == "b");
+}
+
+TEST(bind, unsupported) {
+  // Nothing is built for a filter to select; it isn't ignored either.
+  json_parser filtered(R"({"x":1,"y":2,"name":"a"})",
+                       json_buffer_mode::borrow);
+  filtered.filter({"$.x"});
+  point p;
+  CHECK(!filtered.parse_into(p));
+  CHECK(filtered.error());
+
+  // Pushed input can cut a token that was already read.
+  json_parser pushed;
+  pushed.feed(R"({"x":1,"na)");
+  CHECK(!pushed.parse_into(p));
+  CHECK(pushed.error());
+}
@@ -0,0 +1,98 @@
+#include "jsonparser.h"
+#include "jsonsax.h"
+#include "test.h"
+
+using namespace jsonparser;
+
+///===-----------------------------------------------------------------------===
+///
+///               Event Parsing
+///
+///===-----------------------------------------------------------------------===
+
+// Spells every event out in a line: { } [ ] for containers, k:key, s:str,
+// n:text and the literals.
+struct event_log : json_handler {
+  std::string log;
+
+  bool on_start_object() { return add("{"); }
+  bool on_end_object() { return add("}"); }
+  bool on_start_array() { return add("["); }
+  bool on_end_array() { return add("]"); }
+  bool on_key(std::string_view key) { return add("k:" + std::string(key)); }
+  bool on_string(std::string_view str) {
+    return add("s:" + std::string(str));
+  }
+  bool on_number(const json_number &, std::string_view text) {
+    return add("n:" + std::string(text));
+  }
+  bool on_bool(bool value) { return add(value ? "true" : "false"); }
+  bool on_null() { return add("null"); }
+
+  bool add(const std::string &event) {
+    log += log.empty() ? "" : " ";
+    log += event;
+    return true;
+  }
+};
+
+TEST(events, document) {
+  json_parser ps(R"({"a":[1,"xA",true,null],"b":-0})",
+                 json_buffer_mode::borrow);
+  event_log events;
+  CHECK(ps.parse_events(events));
+  CHECK_FOR(events.log == "{ k:a [ n:1 s:xA true null ] k:b n:-0 }",
+            events.log);
+}
+
+TEST(events, sequence) {
+  json_parser ps("{\"a\":1}\n[2]\n[] {\"b\":\"c\"}\n",
+                 json_buffer_mode::borrow);
+  ps.sequence() = true;
+  std::vector<std::string> documents;
+  while (ps.more()) {
+    event_log events;
+    CHECK(ps.parse_events(events));
+    if (ps.error())
+      break;
+    documents.push_back(events.log);
+  }
+  CHECK(documents.size() == 4);
+  CHECK(documents.size() == 4 && documents[0] == "{ k:a n:1 }" &&
+        documents[1] == "[ n:2 ]" && documents[2] == "[ ]" &&
+        documents[3] == "{ k:b s:c }");
+}
+
+TEST(events, fragment) {
+  struct piece {
+    const char *text;
+    bool open, close;
+    const char *log;
+  };
+  for (const piece &p : {
+           piece{"1, 2", true, true, "[ n:1 n:2 ]"},
+           piece{"[1, 2", false, true, "[ n:1 n:2 ]"},
+           piece{"1, {\"a\":2}]", true, false, "[ n:1 { k:a n:2 } ]"},
+       }) {
+    json_parser ps(p.text, json_buffer_mode::borrow);
+    ps.fragment(p.open, p.close);
+    event_log events;
+    CHECK_FOR(ps.parse_events(events), p.text);
+    CHECK_FOR(events.log == p.log, events.log);
+  }
+}
+
+TEST(events, unsupported) {
+  // Nothing is built for a filter to select.
+  json_parser filtered("{\"a\":1}", json_buffer_mode::borrow);
+  filtered.filter({"$.a"});
+  event_log events;
+  CHECK(!filtered.parse_events(events));
+  CHECK(filtered.error());
+
+  // Nor can events be taken back when pushed input cuts a token.
+  json_parser pushed;
+  pushed.feed("[1,");
+  CHECK(!pushed.parse_events(events));
+  CHECK(pushed.error());
+}
@@ -0,0 +1,61 @@
+#include "jsonlines.h"
+#include "test.h"
+#include <string.h>
+
+using namespace jsonparser;
+
+///===-----------------------------------------------------------------------===
+///
+///               Json Lines
+///
+///===-----------------------------------------------------------------------===
+
+// Lines of {"i":n} until the input is at least size bytes; returns how many.
+static size_t fill_lines(std::string &out, size_t size) {
+  size_t lines = 0;
+  while (out.size() < size)
+    out += "{\"i\":" + std::to_string(lines++) + "}\n";
+  return lines;
+}
+
+TEST(lines, valid) {
+  std::string input = "\n{\"a\":1}\n\n  [1,2]  \r\n";
+  size_t lines = fill_lines(input, json_lines_reader::chunk_size * 3);
+  json_lines_reader reader(input.data(), input.size(),
+                           json_buffer_mode::borrow, 4);
+  CHECK(reader.parse());
+  CHECK(reader.error_line() == 0);
+  CHECK(reader.documents().size() == lines + 2);
+}
+
+TEST(lines, one_document_per_line) {
+  for (const char *input : {
+           "{\"a\":1}\n{\"b\":\n2}\n{\"c\":3}\n",
+           "{\"a\":1}\n[1,\n2]\n",
+           "{\"a\":1}\n{\"b\":2} {\"c\":3}\n",
+       }) {
+    json_lines_reader reader(input, strlen(input), json_buffer_mode::borrow);
+    CHECK_FOR(!reader.parse(), input);
+    CHECK_FOR(reader.error_line() == 2, input);
+    CHECK_FOR(reader.documents().size() == 1, input);
+  }
+}
+
+TEST(lines, document_across_chunks) {
+  // The same document spanning two lines, shifted across the first chunk
+  // boundary: the error doesn't depend on where the input is cut.
+  for (size_t shift = 0; shift < 48; shift++) {
+    std::string input;
+    size_t lines = fill_lines(input, json_lines_reader::chunk_size - 24);
+    input.append(shift, ' ');
+    input += "{\"split\":\n\"here\"}\n";
+    fill_lines(input, json_lines_reader::chunk_size * 2);
+
+    json_lines_reader reader(input.data(), input.size(),
+                             json_buffer_mode::borrow, 2);
+    std::string at = "shift " + std::to_string(shift);
+    CHECK_FOR(!reader.parse(), at);
+    CHECK_FOR(reader.error_line() == lines + 1, at);
+    CHECK_FOR(reader.documents().size() == lines, at);
+  }
+}
@@ -0,0 +1,52 @@
+#include "test.h"
+#include <fstream>
+#include <iterator>
+#include <string.h>
+
+static size_t failures = 0;
+
+std::vector<test_case> &test_cases() {
+  static std::vector<test_case> cases;
+  return cases;
+}
+
+void test_failed(const char *file, int line, const char *what,
+                 const std::string &detail) {
+  // A loop over many inputs fails many times alike; the first few tell.
+  if (failures++ < 20)
+    printf("%s:%d: CHECK(%s) failed%s%s\n", file, line, what,
+           detail.empty() ? "" : " for ", detail.c_str());
+}
+
+std::string test_file(const char *name) {
+  std::ifstream ifs(std::string(JSONPARSER_SOURCE_DIR) + "/" + name,
+                    std::ios::binary);
+  if (!ifs)
+    test_failed(__FILE__, __LINE__, "test_file", name);
+  return std::string(std::istreambuf_iterator<char>(ifs),
+                     std::istreambuf_iterator<char>());
+}
+
+int main(int argc, char *argv[]) {
+  size_t run = 0;
+  for (auto &test : test_cases()) {
+    bool selected = argc < 2;
+    for (int i = 1; i < argc; i++)
+      selected |= !strcmp(argv[i], test.group);
+    if (!selected)
+      continue;
+
+    size_t before = failures;
+    test.run();
+    printf("%-6s %s.%s\n", failures == before ? "ok" : "FAILED", test.group,
+           test.name);
+    run++;
+  }
+
+  if (!run) {
+    printf("no tests selected\n");
+    return 1;
+  }
+  printf("%zu tests, %zu failed checks\n", run, failures);
+  return failures != 0;
+}
@@ -0,0 +1,184 @@
+#include "jsonnumber.h"
+#include "jsonparser.h"
+#include "test.h"
+#include <cmath>
+#include <cstdint>
+#include <memory.h>
+#include <sstream>
+#include <stdlib.h>
+
+using namespace jsonparser;
+
+///===-----------------------------------------------------------------------===
+///
+///               Number Decoding
+///
+///===-----------------------------------------------------------------------===
+
+static uint64_t bits_of(double d) {
+  uint64_t bits;
+  memcpy(&bits, &d, sizeof(d));
+  return bits;
+}
+
+// Reals and integers beyond 64 bits must be the double strtod gives,
+// bit for bit; 64-bit integers must be exact. The shortest text printed
+// for the value must read back as the same value.
+static void check_decode(const std::string &text) {
+  json_number num;
+  bool ok = json_decode_number(text.data(), text.data() + text.size(), num);
+  CHECK_FOR(ok, text);
+  if (!ok)
+    return;
+
+  switch (num.type) {
+  case json_number_type::int64:
+    CHECK_FOR(num.i == strtoll(text.c_str(), nullptr, 10), text);
+    break;
+  case json_number_type::uint64:
+    CHECK_FOR(num.u == strtoull(text.c_str(), nullptr, 10), text);
+    break;
+  default:
+    CHECK_FOR(bits_of(num.d) == bits_of(strtod(text.c_str(), nullptr)), text);
+    break;
+  }
+
+  if (num.exact()) {
+    char out[json_number_chars];
+    std::string printed(out, json_format_number(num, out) - out);
+    json_number back;
+    const char *first = printed.data();
+    CHECK_FOR(json_decode_number(first, first + printed.size(), back), printed);
+    CHECK_FOR(back.type == num.type || num.type == json_number_type::real,
+              printed);
+    CHECK_FOR(bits_of(back.as_double()) == bits_of(num.as_double()), printed);
+  }
+}
+
+TEST(numbers, halfway) {
+  // Exactly between two doubles: ties go to the even mantissa.
+  for (const char *text : {
+           "9007199254740993.0",
+           "9007199254740995e0",
+           "9007199254740993.00000000000000000001",
+           "1.00000000000000011102230246251565404236316680908203125",
+           "1.00000000000000011102230246251565404236316680908203124",
+           "1.00000000000000011102230246251565404236316680908203126",
+           "1.0000000000000002220446049250313080847263336181640625",
+           "1.00000000000000033306690738754696212708950042724609375",
+           "8.98846567431158053e307",
+           "1.7976931348623157e308",
+           "1.7976931348623158e308",
+           "1.7976931348623159e308",
+           "179769313486231580793728971405303415079934132710037826936173778980"
+           "444968292764750946649017977587207096330286416692887910946555547851"
+           "940402630657488671505820681908902000708383676273854845817711531764"
+           "475730270069855571366959622842914819860834936475292719074168444365"
+           "510704342711559699508093042880177904174497792.0",
+           "0.1",
+           "0.2",
+           "0.3",
+           "2.5",
+           "3.5",
+           "1e23",
+           "8.589973e9",
+           "7.038531e-26",
+           "9.5e-5",
+       })
+    check_decode(text);
+}
+
+TEST(numbers, subnormal) {
+  for (const char *text : {
+           "4.9406564584124654e-324",
+           "5e-324",
+           "3e-324",
+           "2.4703282292062328e-324",
+           "2.4703282292062327e-324",
+           "2.47032822920623272e-324",
+           "1e-320",
+           "2.2250738585072009e-308",
+           "2.2250738585072011e-308",
+           "2.2250738585072012e-308",
+           "2.2250738585072014e-308",
+           "4.4501477170144023e-308",
+           "1e-400",
+           "-1e-400",
+           "0.000000000000000000000000000000000000000000000000000000000000"
+           "0000000000000000000000000000000000000000000000000000000000000001",
+       })
+    check_decode(text);
+}
+
+TEST(numbers, long_mantissa) {
+  // 19 digits still fit the 64-bit accumulator, 20 may not.
+  for (const char *text : {
+           "1234567890123456789e-10",
+           "12345678901234567890e-10",
+           "9999999999999999999e0",
+           "99999999999999999999e0",
+           "18446744073709551615e0",
+           "18446744073709551616e0",
+           "9223372036854775807",
+           "9223372036854775808",
+           "-9223372036854775808",
+           "-9223372036854775809",
+           "18446744073709551615",
+           "18446744073709551616",
+           "123456789012345678901234567890",
+           "0.1000000000000000055511151231257827021181583404541015625",
+           "0.00000000000000000001234567890123456789",
+           "1844674407370955161.5",
+           "7.3177701707893310e+15",
+           "3.0540412e5",
+       })
+    check_decode(text);
+}
+
+// xorshift64*, so every run checks the same inputs.
+static uint64_t next_random(uint64_t &state) {
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 0x2545f4914f6cdd1dull;
+}
+
+TEST(numbers, random) {
+  uint64_t state = 0x9e3779b97f4a7c15ull;
+  std::string text;
+  for (int i = 0; i < 200000; i++) {
+    text.clear();
+    if (next_random(state) & 1)
+      text += '-';
+    // Mostly the 15 to 20 digits around the fast path's limits.
+    size_t digits = 15 + next_random(state) % 6;
+    if (!(next_random(state) % 4))
+      digits = 1 + next_random(state) % 40;
+    text += (char)('1' + next_random(state) % 9);
+    size_t point = next_random(state) % (digits + 1);
+    for (size_t d = 1; d < digits; d++) {
+      if (d == point)
+        text += '.';
+      text += (char)('0' + next_random(state) % 10);
+    }
+    if (next_random(state) % 4) {
+      text += 'e';
+      text += std::to_string((int)(next_random(state) % 700) - 350);
+    }
+    check_decode(text);
+  }
+}
+
+TEST(numbers, negative_zero) {
+  json_number num;
+  const char text[] = "-0";
+  CHECK(json_decode_number(text, text + 2, num));
+  CHECK(num.type == json_number_type::real);
+  CHECK(num.d == 0 && std::signbit(num.d));
+
+  std::ostringstream os;
+  json_parser ps("[-0,0,-0.0,-0e5]", json_buffer_mode::borrow);
+  CHECK(ps.parse());
+  ps.entry()->print(os);
+  CHECK_FOR(os.str() == "[-0.0,0,-0.0,-0.0]", os.str());
+}
@@ -0,0 +1,95 @@
+#include "jsonparser.h"
+#include "test.h"
+#include <algorithm>
+#include <sstream>
+
+using namespace jsonparser;
+
+///===-----------------------------------------------------------------------===
+///
+///               Push Parsing
+///
+///===-----------------------------------------------------------------------===
+
+static std::string printed(json_parser &ps) {
+  std::ostringstream os;
+  if (ps.entry())
+    ps.entry()->print(os);
+  return os.str();
+}
+
+// Escapes, surrogate pairs, long numbers and literals, for a cut inside each.
+static const char *const documents[] = {
+    R"({"café":"😀 \"quoted\" \\ \/ \b\f\n\r\t","e":"€"})",
+    "[123456789012345678901234567890,-0.000000000000000000000001234567,"
+    "1.7976931348623157e308,-9223372036854775808,18446744073709551615,"
+    "true,false,null,[],{}]",
+    "  {\"a\" : [ 1 , { \"b\" : null } ] ,\n \"c\" : \"\" }  ",
+};
+
+static void check_pieces(const std::string &input) {
+  json_parser borrowed(input, json_buffer_mode::borrow);
+  CHECK_FOR(borrowed.parse(), input);
+  std::string expected = printed(borrowed);
+
+  // In two pieces cut at every offset, then byte by byte.
+  for (size_t cut = 0; cut <= input.size(); cut++) {
+    json_parser ps;
+    bool ok = ps.feed(input.data(), cut) &&
+              ps.feed(input.data() + cut, input.size() - cut) && ps.finish();
+    std::string at = "cut at " + std::to_string(cut) + " of " + input;
+    CHECK_FOR(ok, at);
+    CHECK_FOR(printed(ps) == expected, at);
+  }
+
+  json_parser ps;
+  bool ok = true;
+  for (char c : input)
+    ok = ok && ps.feed(&c, 1);
+  CHECK_FOR(ok && ps.finish(), input);
+  CHECK_FOR(printed(ps) == expected, input);
+}
+
+TEST(push, examples) {
+  check_pieces(test_file("example1.json"));
+  check_pieces(test_file("example2.json"));
+}
+
+TEST(push, tokens) {
+  for (const char *input : documents)
+    check_pieces(input);
+
+  // A token much longer than the pieces it comes in.
+  std::string input = "[\"" + std::string(100000, 's') + "\"," +
+                      std::string(5000, '9') + "]";
+  json_parser ps;
+  bool ok = true;
+  for (size_t at = 0; at < input.size(); at += 7) {
+    size_t size = std::min<size_t>(7, input.size() - at);
+    ok = ok && ps.feed(input.data() + at, size);
+  }
+  CHECK(ok && ps.finish());
+  json_parser borrowed(input, json_buffer_mode::borrow);
+  CHECK(borrowed.parse());
+  CHECK(printed(ps) == printed(borrowed));
+}
+
+TEST(push, truncated) {
+  // Cut anywhere short of its end, a document is complete to feed(), and
+  // only finish() finds it isn't.
+  std::vector<std::string> inputs(std::begin(documents), std::end(documents));
+  inputs.push_back(test_file("example2.json"));
+  for (const std::string &input : inputs) {
+    for (size_t size = 0; size < input.size(); size++) {
+      std::string cut = input.substr(0, size);
+      json_parser complete(cut, json_buffer_mode::borrow);
+      if (complete.parse())
+        continue;
+      json_parser ps;
+      std::string at = "cut to " + std::to_string(size) + " of " + input;
+      CHECK_FOR(ps.feed(cut), at);
+      CHECK_FOR(!ps.finish(), at);
+      CHECK_FOR(ps.error(), at);
+    }
+  }
+}
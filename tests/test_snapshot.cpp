@@ -0,0 +1,124 @@
+#include "jsonparser.h"
+#include "jsonsnapshot.h"
+#include "jsontape.h"
+#include "jsonwriter.h"
+#include "test.h"
+#include <cmath>
+#include <stdio.h>
+
+using namespace jsonparser;
+
+///===-----------------------------------------------------------------------===
+///
+///               Tapes and Snapshots
+///
+///===-----------------------------------------------------------------------===
+
+// Numbers a double or a 64-bit integer can't hold, and their neighbours.
+static const char *const documents[] = {
+    "[1e400,-1e400,123456789012345678901234567890,-0,1.5]",
+    "{\"big\":-123456789012345678901234567890,\"inf\":1E+999,\"n\":[0,-0.0]}",
+    "[18446744073709551615,18446744073709551616,-9223372036854775808,"
+    "-9223372036854775809,2e-400,1.7976931348623157e308]",
+};
+
+// Written back: raw numbers as they came, the others in their shortest form,
+// -0 as a real.
+static const char *const expected[] = {
+    "[1e400,-1e400,123456789012345678901234567890,-0.0,1.5]",
+    "{\"big\":-123456789012345678901234567890,\"inf\":1E+999,\"n\":[0,-0.0]}",
+    "[18446744073709551615,18446744073709551616,-9223372036854775808,"
+    "-9223372036854775809,0.0,1.7976931348623157e+308]",
+};
+
+static std::string written(const json_tape_ref &root) {
+  std::string out;
+  {
+    json_writer writer(out);
+    writer.write(root);
+  }
+  return out;
+}
+
+TEST(snapshot, tape_round_trip) {
+  for (size_t i = 0; i < sizeof(documents) / sizeof(documents[0]); i++) {
+    json_parser ps(documents[i], json_buffer_mode::borrow);
+    json_tape tape;
+    CHECK_FOR(ps.parse(tape), documents[i]);
+    std::string out = written(tape.root());
+    CHECK_FOR(out == expected[i], out);
+
+    // The DOM agrees.
+    json_parser dom(documents[i], json_buffer_mode::borrow);
+    CHECK_FOR(dom.parse(), documents[i]);
+    std::string tree;
+    {
+      json_writer writer(tree);
+      writer.write(*dom.entry());
+    }
+    CHECK_FOR(tree == out, tree);
+  }
+}
+
+TEST(snapshot, file_round_trip) {
+  const char *path = "jsonparser_test.snapshot";
+  for (size_t i = 0; i < sizeof(documents) / sizeof(documents[0]); i++) {
+    json_parser ps(documents[i], json_buffer_mode::borrow);
+    json_tape tape;
+    CHECK_FOR(ps.parse(tape), documents[i]);
+    CHECK_FOR(json_snapshot::write(tape, path), path);
+    CHECK_FOR(json_snapshot::detect(path), path);
+
+    json_snapshot snap(path);
+    std::string out = written(snap.root());
+    CHECK_FOR(out == expected[i], out);
+
+    // Printed raw numbers parse again, to the same tape.
+    json_parser again(out, json_buffer_mode::borrow);
+    json_tape tape_again;
+    CHECK_FOR(again.parse(tape_again), out);
+    CHECK_FOR(tape_again.words == tape.words, out);
+  }
+  remove(path);
+}
+
+TEST(snapshot, raw_numbers) {
+  json_parser ps("[1e400,123456789012345678901234567890,7]",
+                 json_buffer_mode::borrow);
+  json_tape tape;
+  CHECK(ps.parse(tape));
+  json_tape_ref root = tape.root();
+  CHECK(root.size() == 3);
+
+  json_tape_ref inf = root.at(0);
+  CHECK(inf.is_raw_number() && inf.is_numeric());
+  CHECK(inf.get_raw_number() == "1e400");
+  CHECK(std::isinf(inf.get_double()));
+
+  json_tape_ref big = root.at(1);
+  CHECK(big.is_raw_number());
+  CHECK(big.get_raw_number() == "123456789012345678901234567890");
+  CHECK(big.get_double() == 123456789012345678901234567890.0);
+
+  CHECK(root.at(2).is_int64() && root.at(2).get_int64() == 7);
+}
+
+TEST(snapshot, non_finite) {
+  // Nothing in JSON spells a value without text: it is written as null.
+  json_number num;
+  num.type = json_number_type::real;
+  char out[json_number_chars];
+  for (double d : {HUGE_VAL, -HUGE_VAL, std::nan("")}) {
+    num.d = d;
+    std::string text(out, json_format_number(num, out) - out);
+    CHECK_FOR(text == "null", text);
+  }
+
+  std::string tree;
+  {
+    json_numeric value(num);
+    json_writer writer(tree);
+    writer.write(value);
+  }
+  CHECK_FOR(tree == "null", tree);
+}
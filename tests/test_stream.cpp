@@ -0,0 +1,132 @@
+#include "jsonparser.h"
+#include "jsonsource.h"
+#include "test.h"
+#include <algorithm>
+#include <string.h>
+
+using namespace jsonparser;
+
+///===-----------------------------------------------------------------------===
+///
+///               Streamed Blocks
+///
+///===-----------------------------------------------------------------------===
+
+// A string handed out block by block, as a file would be.
+class memory_source : public json_block_source {
+  std::string data;
+  size_t at = 0;
+
+public:
+  memory_source(std::string data) : data(std::move(data)) {}
+
+  long long read(char *out, long long size) override {
+    size_t count = std::min((size_t)size, data.size() - at);
+    memcpy(out, data.data() + at, count);
+    at += count;
+    return count;
+  }
+  long long size() const override { return data.size(); }
+};
+
+// The same, failing once it has handed out the first cut bytes.
+class failing_source : public memory_source {
+  long long cut;
+
+public:
+  failing_source(std::string data, long long cut)
+      : memory_source(std::move(data)), cut(cut) {}
+
+  long long read(char *out, long long size) override {
+    if (size > cut)
+      return -1;
+    cut -= size;
+    return memory_source::read(out, size);
+  }
+};
+
+// Every token in a line: its type, offset and text, decoded for strings.
+static std::string tokens(json_lexer &lex) {
+  std::string out;
+  while (true) {
+    if (!lex.next())
+      return out + "failed";
+    out += std::to_string((int)lex.type()) + '@' +
+           std::to_string(lex.token_position()) + ' ';
+    if (lex.type() == json_token::eof)
+      return out;
+    out += lex.type() == json_token::v_string ? lex.str()
+                                              : std::string(lex.view());
+    out += '\n';
+  }
+}
+
+static void check_streamed(const std::string &input, long long block) {
+  json_lexer borrowed(input, json_buffer_mode::borrow);
+  std::string expected = tokens(borrowed);
+
+  json_lexer streamed(std::make_unique<memory_source>(input), block);
+  std::string got = tokens(streamed);
+  std::string at = "block " + std::to_string(block) + ", " +
+                   std::to_string(input.size()) + " bytes";
+  CHECK_FOR(got == expected, at);
+  CHECK_FOR(streamed.position() == (long long)input.size(), at);
+}
+
+// A token of every kind, with escapes and surrogate pairs.
+static const char mixed[] =
+    R"({"name":"caf\u00e9 \ud83d\ude00","list":[true,false,null,-0,)"
+    R"(1.5e-300,123456789012345678901234567890,"a\"b\\c\n"],)"
+    R"("nested":{"x":[[],{}],"y":"\/"}})";
+
+TEST(stream, small_blocks) {
+  // Blocks shorter than most tokens: each is cut at every offset.
+  std::string input = test_file("example2.json") + mixed;
+  for (long long block = 1; block <= 80; block++) {
+    check_streamed(mixed, block);
+    check_streamed(input, block);
+  }
+  check_streamed(test_file("example1.json"), 3);
+}
+
+TEST(stream, long_tokens) {
+  // Tokens longer than a block are carried over in the headroom in front of
+  // the next one; those longer than the headroom (64 KB) are joined with it
+  // in a buffer of their own, and the blocks grow.
+  std::string input = "[";
+  for (size_t length : {10, 63, 64, 65, 1000, 4097, 65535, 65536, 65537,
+                        70000, 300000}) {
+    input += '"' + std::string(length, 'x') + "\\u00e9\",";
+    input += std::string(length % 5000, '7') + ",";
+    input += mixed;
+    input += ",\n";
+  }
+  input += "null]";
+  for (long long block : {64, 4096, 100000})
+    check_streamed(input, block);
+}
+
+TEST(stream, source_error) {
+  // A source failing mid-input ends it with an error, wherever a block
+  // boundary cuts the tokens.
+  std::string input = test_file("example2.json");
+  for (long long cut : {0, 64, 128, 640}) {
+    json_lexer lex(std::make_unique<failing_source>(input, cut), 64);
+    std::string at = "cut " + std::to_string(cut);
+    std::string got = tokens(lex);
+    CHECK_FOR(got.size() >= 6 && got.substr(got.size() - 6) == "failed", at);
+    CHECK_FOR(lex.source_error(), at);
+  }
+
+  // A parser tells it from an error in the JSON itself.
+  json_parser failed(std::make_unique<failing_source>(input, 0));
+  CHECK(!failed.parse());
+  CHECK(failed.error() && failed.source_error());
+
+  json_parser malformed(std::make_unique<memory_source>("{\"a\":]"));
+  CHECK(!malformed.parse());
+  CHECK(malformed.error() && !malformed.source_error());
+
+  json_parser complete(std::make_unique<memory_source>(input));
+  CHECK(complete.parse() && !complete.source_error());
+}
@@ -0,0 +1,184 @@
+#include "jsonindex.h"
+#include "jsonparser.h"
+#include "jsonutf8.h"
+#include "test.h"
+#include <cstdint>
+
+using namespace jsonparser;
+
+///===-----------------------------------------------------------------------===
+///
+///               UTF-8 Validation
+///
+///===-----------------------------------------------------------------------===
+
+// Well-formed sequences by Table 3-7 of the Unicode standard, byte by byte:
+// the length of the longest valid prefix.
+static size_t reference_validate(const std::string &s) {
+  const unsigned char *p = (const unsigned char *)s.data();
+  size_t n = s.size(), i = 0;
+  while (i < n) {
+    unsigned c = p[i];
+    int length;
+    unsigned low = 0x80, high = 0xbf;
+    if (c < 0x80)
+      length = 1;
+    else if (c >= 0xc2 && c <= 0xdf)
+      length = 2;
+    else if (c == 0xe0)
+      length = 3, low = 0xa0;
+    else if ((c >= 0xe1 && c <= 0xec) || c == 0xee || c == 0xef)
+      length = 3;
+    else if (c == 0xed)
+      length = 3, high = 0x9f;
+    else if (c == 0xf0)
+      length = 4, low = 0x90;
+    else if (c >= 0xf1 && c <= 0xf3)
+      length = 4;
+    else if (c == 0xf4)
+      length = 4, high = 0x8f;
+    else
+      return i;
+
+    if (i + length > n)
+      return i;
+    for (int k = 1; k < length; k++) {
+      if (p[i + k] < (k == 1 ? low : 0x80) || p[i + k] > (k == 1 ? high : 0xbf))
+        return i;
+    }
+    i += length;
+  }
+  return n;
+}
+
+// Run check once with every instruction set the processor has.
+template <typename function> static void for_each_isa(function check) {
+  using isa = json_structural_index::isa;
+  isa saved = json_structural_index::active();
+  for (isa target : {isa::scalar, isa::sse42, isa::avx2}) {
+    json_structural_index::force(target);
+    if (json_structural_index::active() == target)
+      check(json_structural_index::name(target));
+  }
+  json_structural_index::force(saved);
+}
+
+static std::string hex(const std::string &s) {
+  static const char digits[] = "0123456789abcdef";
+  std::string out;
+  for (unsigned char c : s) {
+    out += digits[c >> 4];
+    out += digits[c & 15];
+    out += ' ';
+  }
+  return out;
+}
+
+static void check_validate(const std::string &s, const char *isa) {
+  size_t expected = reference_validate(s);
+  size_t valid = json_utf8_validate(s.data(), s.size());
+  CHECK_FOR(valid == expected, std::string(isa) + ": " + hex(s));
+}
+
+// Valid and invalid sequences, complete and cut short.
+static const char *const sequences[] = {
+    "\xc3\xa9",         "\xe2\x82\xac",     "\xf0\x9f\x98\x80",
+    "\xed\x9f\xbf",     "\xee\x80\x80",     "\xf4\x8f\xbf\xbf",
+    "\xc3",             "\xe2\x82",         "\xf0\x9f\x98",
+    "\xc0\xaf",         "\xc1\xbf",         "\xe0\x80\xaf",
+    "\xe0\x9f\xbf",     "\xf0\x80\x80\xaf", "\xf0\x8f\xbf\xbf",
+    "\xed\xa0\x80",     "\xed\xbf\xbf",     "\xf4\x90\x80\x80",
+    "\xf5\x80\x80\x80", "\xff",             "\x80",
+    "\xbf\xbf",         "\xe2\x28\xa1",     "\xf0\x28\x8c\x28",
+};
+
+TEST(utf8, block_boundaries) {
+  // Each sequence at every offset of a 160 byte run, so it crosses the 16,
+  // 32 and 64 byte blocks the kernels work in. Before it either ASCII, which
+  // vector code skips, or a valid multi-byte character.
+  for_each_isa([](const char *isa) {
+    for (const char *sequence : sequences) {
+      for (size_t at = 0; at < 140; at++) {
+        for (bool ascii : {true, false}) {
+          std::string s(at, 'a');
+          if (!ascii)
+            for (size_t i = 0; i + 2 <= at; i += 2)
+              s.replace(i, 2, "\xc3\xa9");
+          s += sequence;
+          check_validate(s, isa);
+          s.append(160 - s.size() % 160, 'b');
+          check_validate(s, isa);
+        }
+      }
+    }
+  });
+}
+
+// xorshift64*, so every run checks the same inputs.
+static uint64_t next_random(uint64_t &state) {
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 0x2545f4914f6cdd1dull;
+}
+
+TEST(utf8, random) {
+  for_each_isa([](const char *isa) {
+    uint64_t state = 0x2545f4914f6cdd1dull;
+    for (int i = 0; i < 50000; i++) {
+      std::string s;
+      size_t size = next_random(state) % 200;
+      while (s.size() < size) {
+        if (next_random(state) % 3)
+          s.append(next_random(state) % 40, 'x');
+        s += sequences[next_random(state) % 6];
+      }
+      // A few bytes flipped, maybe the last one cut.
+      for (int k = next_random(state) % 3; k > 0 && !s.empty(); k--)
+        s[next_random(state) % s.size()] = (char)next_random(state);
+      if (next_random(state) % 4 == 0 && !s.empty())
+        s.pop_back();
+      check_validate(s, isa);
+    }
+  });
+}
+
+TEST(utf8, replace) {
+  // The example of the Unicode standard, section 3.9: every maximal
+  // subpart of an ill-formed sequence becomes one U+FFFD.
+  const std::string bad = "a\xf1\x80\x80\xe1\x80\xc2" "b\x80" "c\x80\xbf" "d";
+  const std::string fffd = "\xef\xbf\xbd";
+  const std::string good =
+      "a" + fffd + fffd + fffd + "b" + fffd + "c" + fffd + fffd + "d";
+  for_each_isa([&](const char *isa) {
+    for (size_t at = 0; at < 80; at++) {
+      std::string prefix(at, 'z');
+      std::string out;
+      json_utf8_replace((prefix + bad).data(), at + bad.size(), out);
+      CHECK_FOR(out == prefix + good, std::string(isa) + ": " + hex(out));
+    }
+  });
+}
+
+TEST(utf8, lexer) {
+  // A character cut by the end of a string that straddles a block.
+  for_each_isa([](const char *isa) {
+    for (size_t at = 50; at < 80; at++) {
+      std::string text(at, 'q');
+      std::string document = "[\"" + text + "\xe2\x82\"]";
+
+      json_parser rejecting(document, json_buffer_mode::borrow);
+      CHECK_FOR(!rejecting.parse(), isa);
+
+      json_parser replacing(document, json_buffer_mode::borrow);
+      replacing.utf8() = json_utf8_mode::replace;
+      CHECK_FOR(replacing.parse(), isa);
+      std::string printed;
+      if (replacing.entry()) {
+        auto array = static_cast<const json_array *>(&*replacing.entry());
+        printed = static_cast<const json_string &>(*array->array[0]).str;
+      }
+      CHECK_FOR(printed == text + "\xef\xbf\xbd", isa);
+    }
+  });
+}